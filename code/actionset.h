@@ -0,0 +1,70 @@
+#ifndef ACTION_SET_H
+#define ACTION_SET_H
+
+#include <assert.h>
+
+//-----------------------------------------------------------------------------
+// Fixed-capacity set of action indices, stored inline so that legal and
+// preferred action generation never touches the heap during search.
+// Mirrors the subset of the std::vector interface used by the simulators.
+
+class ACTION_SET
+{
+public:
+
+	static const int MaxActions = 128;
+
+	ACTION_SET()
+		: Count(0)
+	{
+	}
+
+	ACTION_SET(const ACTION_SET& other)
+		: Count(other.Count)
+	{
+		for (int i = 0; i < Count; ++i)
+			Actions[i] = other.Actions[i];
+	}
+
+	ACTION_SET& operator=(const ACTION_SET& other)
+	{
+		Count = other.Count;
+		for (int i = 0; i < Count; ++i)
+			Actions[i] = other.Actions[i];
+		return *this;
+	}
+
+	void push_back(int action)
+	{
+		assert(Count < MaxActions);
+		Actions[Count++] = action;
+	}
+
+	void clear() { Count = 0; }
+	bool empty() const { return Count == 0; }
+	int size() const { return Count; }
+
+	int& operator[](int i)
+	{
+		assert(i >= 0 && i < Count);
+		return Actions[i];
+	}
+
+	int operator[](int i) const
+	{
+		assert(i >= 0 && i < Count);
+		return Actions[i];
+	}
+
+	int* begin() { return Actions; }
+	int* end() { return Actions + Count; }
+	const int* begin() const { return Actions; }
+	const int* end() const { return Actions + Count; }
+
+private:
+
+	int Actions[MaxActions];
+	int Count;
+};
+
+#endif // ACTION_SET_H
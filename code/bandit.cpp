@@ -34,7 +34,7 @@ int Bandit::play()
 	return play(actionPlayCandidates);
 }
 
-int Bandit::play(const std::vector<int>& legalArms)
+int Bandit::play(const ACTION_SET& legalArms)
 {
 	means.clear();
 	for (int index = 0; index < legalArms.size(); index++)
@@ -59,13 +59,13 @@ int Bandit::sample()
 	return playIndex;
 }
 
-int Bandit::sampleFrom(const std::vector<int>& legalArms)
+int Bandit::sampleFrom(const ACTION_SET& legalArms)
 {
 	playIndex = sampleArmFrom(legalArms);
 	return playIndex;
 }
 
-int EpsilonGreedy::sampleArmFrom(const std::vector<int>& legalArms)
+int EpsilonGreedy::sampleArmFrom(const ACTION_SET& legalArms)
 {
 	int index = 0;
 	if (randomDouble() <= epsilon)
@@ -81,7 +81,7 @@ UCB1::UCB1(
 	const unsigned int rewardBufferSize,
 	double explorationConstant) : Bandit(numberOfArms, rewardBufferSize), explorationConstant(explorationConstant) {}
 
-int UCB1::sampleArmFrom(const std::vector<int>& legalArms)
+int UCB1::sampleArmFrom(const ACTION_SET& legalArms)
 {
 	upperConfidences.clear();
 	const int numberOfArms = legalArms.size();
@@ -145,7 +145,7 @@ void ThompsonSampling::reset()
 	counts.assign(numberOfArms, 0);
 }
 
-int ThompsonSampling::sampleArmFrom(const std::vector<int>& legalArms)
+int ThompsonSampling::sampleArmFrom(const ACTION_SET& legalArms)
 {
 	sampledMeans.clear();
 	int numberOfArms = legalArms.size();
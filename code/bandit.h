@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <iterator>
 #include "random.h"
+#include "actionset.h"
 #include <boost/random.hpp>
 #include <boost/random/gamma_distribution.hpp>
 #include <time.h>
@@ -125,10 +126,10 @@ public:
 		return playIndex;
 	}
 
-	virtual int play(const std::vector<int>& legalArms);
+	virtual int play(const ACTION_SET& legalArms);
 	int sample();
-	virtual int sampleArmFrom(const std::vector<int>& legalArms) = 0;
-	int sampleFrom(const std::vector<int>& legalArms);
+	virtual int sampleArmFrom(const ACTION_SET& legalArms) = 0;
+	int sampleFrom(const ACTION_SET& legalArms);
 	virtual void update(const double reward);
 	const unsigned int getNumberOfArms() 
 	{
@@ -154,8 +155,7 @@ public:
     }
 	int argmax(std::vector<double>& data) 
 	{
-		static std::vector<int> candidateValueIndices;
-		candidateValueIndices.clear();
+		ACTION_SET candidateValueIndices;
 		double bestValue = -std::numeric_limits<double>::infinity();
 		int n = data.size();
 		for (int index = 0; index < n; index++)
@@ -195,8 +195,8 @@ protected:
 	std::vector<Arm*> arms;
 	std::vector<double> means;
 	std::vector<int> counts;
-	std::vector<int> actions;
-	std::vector<int> actionPlayCandidates;
+	ACTION_SET actions;
+	ACTION_SET actionPlayCandidates;
 };
 
 class RandomBandit : public Bandit 
@@ -204,7 +204,7 @@ class RandomBandit : public Bandit
 public:
 	RandomBandit(const unsigned int numberOfArms) : Bandit(numberOfArms,1) {}
 	virtual ~RandomBandit() {}
-	virtual int sampleArmFrom(const std::vector<int>& legalArms)
+	virtual int sampleArmFrom(const ACTION_SET& legalArms)
 	{
 		return legalArms[randomInt(legalArms.size())];
 	}
@@ -218,7 +218,7 @@ public:
 		const unsigned int rewardBufferSize,
 		double epsilon) : Bandit(numberOfArms, rewardBufferSize), epsilon(epsilon) {}
 	virtual ~EpsilonGreedy() {}
-	virtual int sampleArmFrom(const std::vector<int>& legalArms);
+	virtual int sampleArmFrom(const ACTION_SET& legalArms);
 private:
 	const double epsilon;
 };
@@ -231,7 +231,7 @@ public:
 		const unsigned int rewardBufferSize,
 		double explorationConstant);
 	virtual ~UCB1() {}
-	virtual int sampleArmFrom(const std::vector<int>& legalArms);
+	virtual int sampleArmFrom(const ACTION_SET& legalArms);
 protected:
 	const double explorationConstant;
 	std::vector<double> upperConfidences;
@@ -248,7 +248,7 @@ public:
 	virtual ~ThompsonSampling() {}
 	virtual void update(const double reward);
 	virtual void reset();
-	virtual int sampleArmFrom(const std::vector<int>& legalArms);
+	virtual int sampleArmFrom(const ACTION_SET& legalArms);
 	void flush();
 
 	void setBetaAndLambda(double beta, double lambda) 
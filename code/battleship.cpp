@@ -3,6 +3,7 @@
 #include "utils.h"
 #include <math.h>
 #include <iomanip>
+#include <stdexcept>
 
 using namespace std;
 using namespace UTILS;
@@ -17,6 +18,8 @@ BATTLESHIP::BATTLESHIP(int xsize, int ysize, int maxlength)
 	RewardRange = NumActions / 4.0;
 	Discount = 1;
 	TotalRemaining = MaxLength - 1;
+	if (NumActions > BATTLESHIP_STATE::MaxCells)
+		throw std::invalid_argument("BATTLESHIP: grid has more cells than BATTLESHIP_STATE::MaxCells");
 }
 
 STATE* BATTLESHIP::Copy(const STATE& state) const
@@ -31,9 +34,10 @@ STATE* BATTLESHIP::Copy(const STATE& state) const
 void BATTLESHIP::Validate(const STATE& state) const
 {
 	const BATTLESHIP_STATE& bsstate = safe_cast<const BATTLESHIP_STATE&>(state);
+	const GRID<BATTLESHIP_STATE::CELL>& cells = bsstate.Cells.Get();
 	for (int i = 0; i < XSize * YSize; ++i)
 	{
-		if (bsstate.Cells(i).Diagonal && bsstate.Cells(i).Occupied)
+		if (cells(i).Diagonal && cells(i).Occupied)
 		{
 			DisplayState(bsstate, cout);
 			assert(false);
@@ -44,14 +48,15 @@ void BATTLESHIP::Validate(const STATE& state) const
 STATE* BATTLESHIP::CreateStartState() const
 {
 	BATTLESHIP_STATE* bsstate = MemoryPool.Allocate();
-	bsstate->Cells.Resize(XSize, YSize);
+	GRID<BATTLESHIP_STATE::CELL>& cells = bsstate->Cells.Modify();
+	cells.Resize(XSize, YSize);
 	for (int i = 0; i < XSize * YSize; ++i)
 	{
-		BATTLESHIP_STATE::CELL& cell = bsstate->Cells(i);
+		BATTLESHIP_STATE::CELL& cell = cells(i);
 		cell.Occupied = false;
-		cell.Visited = false;
 		cell.Diagonal = false;
 	}
+	bsstate->Visited.reset();
 	bsstate->NumRemaining = 0;
 
 	bool found;
@@ -79,6 +84,7 @@ STATE* BATTLESHIP::CreateStartState() const
 void BATTLESHIP::FreeState(STATE* state) const
 {
 	BATTLESHIP_STATE* bsstate = safe_cast<BATTLESHIP_STATE*>(state);
+	bsstate->Cells.Release();
 	MemoryPool.Free(bsstate);
 }
 
@@ -87,10 +93,10 @@ bool BATTLESHIP::Step(STATE& state, int action,
 {
 	BATTLESHIP_STATE& bsstate = safe_cast<BATTLESHIP_STATE&>(state);
 
-	COORD actionPos = bsstate.Cells.Coord(action);
+	const GRID<BATTLESHIP_STATE::CELL>& cells = bsstate.Cells.Get();
+	COORD actionPos = cells.Coord(action);
 
-	BATTLESHIP_STATE::CELL& cell = bsstate.Cells(actionPos);
-	if (cell.Visited)
+	if (bsstate.Visited[action])
 	{
 		reward = -10;
 		observation = 0;
@@ -100,23 +106,24 @@ bool BATTLESHIP::Step(STATE& state, int action,
 	}
 	else
 	{
-		if (cell.Occupied) // hit
+		if (cells(actionPos).Occupied) // hit
 		{
 			reward = -1;
 			observation = 1;
 			bsstate.NumRemaining--;
 
 			// Mark four diagonals, not possible for ships to be here
+			GRID<BATTLESHIP_STATE::CELL>& diagonals = bsstate.Cells.Modify();
 			for (int d = 4; d < 8; ++d)
-				if (bsstate.Cells.Inside(actionPos + COORD::Compass[d]))
-					bsstate.Cells(actionPos + COORD::Compass[d]).Diagonal = true;
+				if (diagonals.Inside(actionPos + COORD::Compass[d]))
+					diagonals(actionPos + COORD::Compass[d]).Diagonal = true;
 		}
 		else // miss
 		{
 			reward = -1;
 			observation = 0;
 		}
-		cell.Visited = true;
+		bsstate.Visited[action] = true;
 	}
 
 	if (bsstate.NumRemaining == 0)
@@ -134,8 +141,9 @@ bool BATTLESHIP::LocalMove(STATE& state, const HISTORY& history,
 	int stepObs, const STATUS& status) const
 {
 	BATTLESHIP_STATE& bsstate = safe_cast<BATTLESHIP_STATE&>(state);
+	GRID<BATTLESHIP_STATE::CELL>& cells = bsstate.Cells.Modify();
 	bool refreshDiagonals = history.Size() &&
-		bsstate.Cells(history.Back().Action).Occupied != history.Back().Observation;
+		cells(history.Back().Action).Occupied != history.Back().Observation;
 
 	int mode = Random(3);
 	bool success;
@@ -156,33 +164,76 @@ bool BATTLESHIP::LocalMove(STATE& state, const HISTORY& history,
 
 	if (refreshDiagonals)
 		for (int i = 0; i < XSize * YSize; ++i)
-			bsstate.Cells(i).Diagonal = false;
+			cells(i).Diagonal = false;
 
 	for (int t = 0; t < history.Size(); ++t)
 	{
 		// Ensure that ships are consistent with observation history
 		int a = history[t].Action;
-		COORD pos = bsstate.Cells.Coord(a);
-		const BATTLESHIP_STATE::CELL& cell = bsstate.Cells(a);
-		assert(cell.Visited);
+		COORD pos = cells.Coord(a);
+		const BATTLESHIP_STATE::CELL& cell = cells(a);
+		assert(bsstate.Visited[a]);
 		if (cell.Occupied != history[t].Observation)
 			return false;
 
 		if (refreshDiagonals && cell.Occupied)
 			for (int d = 4; d < 8; ++d)
-				if (bsstate.Cells.Inside(pos + COORD::Compass[d]))
-					bsstate.Cells(pos + COORD::Compass[d]).Diagonal = true;
+				if (cells.Inside(pos + COORD::Compass[d]))
+					cells(pos + COORD::Compass[d]).Diagonal = true;
 	}
 
 	return true;
 }
 
+uint64_t BATTLESHIP::Hash(const STATE& state) const
+{
+	const BATTLESHIP_STATE& bsstate = safe_cast<const BATTLESHIP_STATE&>(state);
+	uint64_t hash = HashCombine(std::hash<std::bitset<BATTLESHIP_STATE::MaxCells> >()(bsstate.Visited),
+		bsstate.NumRemaining);
+
+	// Ship positions determine the occupied cells
+	for (vector<SHIP>::const_iterator i_ship = bsstate.Ships.begin();
+		i_ship != bsstate.Ships.end(); ++i_ship)
+	{
+		hash = HashCombine(hash, XSize * i_ship->Position.Y + i_ship->Position.X);
+		hash = HashCombine(hash, i_ship->Direction);
+	}
+	return hash;
+}
+
+bool BATTLESHIP::Equal(const STATE& state1, const STATE& state2) const
+{
+	const BATTLESHIP_STATE& bsstate1 = safe_cast<const BATTLESHIP_STATE&>(state1);
+	const BATTLESHIP_STATE& bsstate2 = safe_cast<const BATTLESHIP_STATE&>(state2);
+	if (bsstate1.NumRemaining != bsstate2.NumRemaining
+		|| bsstate1.Visited != bsstate2.Visited
+		|| bsstate1.Ships.size() != bsstate2.Ships.size())
+		return false;
+	for (int i = 0; i < (int) bsstate1.Ships.size(); ++i)
+	{
+		const SHIP& ship1 = bsstate1.Ships[i];
+		const SHIP& ship2 = bsstate2.Ships[i];
+		if (ship1.Position != ship2.Position || ship1.Direction != ship2.Direction
+			|| ship1.Length != ship2.Length)
+			return false;
+	}
+
+	const GRID<BATTLESHIP_STATE::CELL>& cells1 = bsstate1.Cells.Get();
+	const GRID<BATTLESHIP_STATE::CELL>& cells2 = bsstate2.Cells.Get();
+	if (&cells1 == &cells2)
+		return true;
+	for (int i = 0; i < XSize * YSize; ++i)
+		if (cells1(i).Occupied != cells2(i).Occupied
+			|| cells1(i).Diagonal != cells2(i).Diagonal)
+			return false;
+	return true;
+}
+
 bool BATTLESHIP::MoveShips(BATTLESHIP_STATE& bsstate) const
 {
 	// Number of ships to move
 	int numMoves = Random(1, 4);
-	static vector<int> shipIndices;
-	shipIndices.clear();
+	vector<int> shipIndices;
 
 	for (int move = 0; move < numMoves; ++move)
 	{
@@ -290,20 +341,21 @@ bool BATTLESHIP::SwitchThreeShips(BATTLESHIP_STATE& bsstate) const
 }
 
 void BATTLESHIP::GenerateLegal(const STATE& state, const HISTORY& history,
-	vector<int>& legal, const STATUS& status) const
+	ACTION_SET& legal, const STATUS& status) const
 {
 	const BATTLESHIP_STATE& bsstate = safe_cast<const BATTLESHIP_STATE&>(state);
+	const GRID<BATTLESHIP_STATE::CELL>& cells = bsstate.Cells.Get();
 	bool diagonals = Knowledge.Level(status.Phase) == KNOWLEDGE::SMART;
 	if (diagonals)
 	{
 		for (int a = 0; a < NumActions; ++a)
-			if (!bsstate.Cells(a).Visited && !bsstate.Cells(a).Diagonal)
+			if (!bsstate.Visited[a] && !cells(a).Diagonal)
 				legal.push_back(a);
 	}
 	else
 	{
 		for (int a = 0; a < NumActions; ++a)
-			if (!bsstate.Cells(a).Visited)
+			if (!bsstate.Visited[a])
 				legal.push_back(a);
 	}
 }
@@ -311,17 +363,18 @@ void BATTLESHIP::GenerateLegal(const STATE& state, const HISTORY& history,
 bool BATTLESHIP::Collision(const BATTLESHIP_STATE& bsstate,
 	const SHIP& ship) const
 {
+	const GRID<BATTLESHIP_STATE::CELL>& cells = bsstate.Cells.Get();
 	COORD pos = ship.Position;
 	for (int i = 0; i < ship.Length; ++i)
 	{
-		if (!bsstate.Cells.Inside(pos))
+		if (!cells.Inside(pos))
 			return true;
-		const BATTLESHIP_STATE::CELL& cell = bsstate.Cells(pos);
+		const BATTLESHIP_STATE::CELL& cell = cells(pos);
 		if (cell.Occupied)
 			return true;
 		for (int adj = 0; adj < 8; ++adj)
-			if (bsstate.Cells.Inside(pos + COORD::Compass[adj]) &&
-				bsstate.Cells(pos + COORD::Compass[adj]).Occupied)
+			if (cells.Inside(pos + COORD::Compass[adj]) &&
+				cells(pos + COORD::Compass[adj]).Occupied)
 				return true;
 		pos += COORD::Compass[ship.Direction];
 	}
@@ -330,13 +383,14 @@ bool BATTLESHIP::Collision(const BATTLESHIP_STATE& bsstate,
 
 void BATTLESHIP::MarkShip(BATTLESHIP_STATE& bsstate, const SHIP& ship) const
 {
+	GRID<BATTLESHIP_STATE::CELL>& cells = bsstate.Cells.Modify();
 	COORD pos = ship.Position;
 	for (int i = 0; i < ship.Length; ++i)
 	{
-		BATTLESHIP_STATE::CELL& cell = bsstate.Cells(pos);
+		BATTLESHIP_STATE::CELL& cell = cells(pos);
 		assert(!cell.Occupied);
 		cell.Occupied = true;
-		if (!cell.Visited)
+		if (!bsstate.Visited[cells.Index(pos)])
 			bsstate.NumRemaining++;
 		pos += COORD::Compass[ship.Direction];
 	}
@@ -344,12 +398,13 @@ void BATTLESHIP::MarkShip(BATTLESHIP_STATE& bsstate, const SHIP& ship) const
 
 void BATTLESHIP::UnmarkShip(BATTLESHIP_STATE& bsstate, const SHIP& ship) const
 {
+	GRID<BATTLESHIP_STATE::CELL>& cells = bsstate.Cells.Modify();
 	COORD pos = ship.Position;
 	for (int i = 0; i < ship.Length; ++i)
 	{
-		BATTLESHIP_STATE::CELL& cell = bsstate.Cells(pos);
+		BATTLESHIP_STATE::CELL& cell = cells(pos);
 		assert(cell.Occupied);
-		if (!cell.Visited)
+		if (!bsstate.Visited[cells.Index(pos)])
 			bsstate.NumRemaining--;
 		cell.Occupied = false;
 		pos += COORD::Compass[ship.Direction];
@@ -369,7 +424,7 @@ void BATTLESHIP::DisplayBeliefs(const BELIEF_STATE& beliefState,
 				beliefState.GetSample(i));
 		for (int x = 0; x < XSize; ++x)
 			for (int y = 0; y < YSize; ++y)
-				counts(x, y) += bsstate->Cells(x, y).Occupied;
+				counts(x, y) += bsstate->Cells.Get()(x, y).Occupied;
 	}
 
 	for (int y = YSize - 1; y >= 0; y--)
@@ -387,6 +442,7 @@ void BATTLESHIP::DisplayBeliefs(const BELIEF_STATE& beliefState,
 void BATTLESHIP::DisplayState(const STATE& state, ostream& ostr) const
 {
 	const BATTLESHIP_STATE& bsstate = safe_cast<const BATTLESHIP_STATE&>(state);
+	const GRID<BATTLESHIP_STATE::CELL>& cells = bsstate.Cells.Get();
 	ostr << endl << "  ";
 	for (int x = 0; x < XSize; x++)
 		ostr << setw(1) << x << ' ';
@@ -396,13 +452,14 @@ void BATTLESHIP::DisplayState(const STATE& state, ostream& ostr) const
 		ostr << setw(1) << y << ' ';
 		for (int x = 0; x < XSize; x++)
 		{
-			const BATTLESHIP_STATE::CELL& cell = bsstate.Cells(x, y);
+			const BATTLESHIP_STATE::CELL& cell = cells(x, y);
+			bool visited = bsstate.Visited[cells.Index(x, y)];
 			char c = '.';
-			if (cell.Occupied && cell.Visited)
+			if (cell.Occupied && visited)
 				c = '@';
-			else if (cell.Occupied && !cell.Visited)
+			else if (cell.Occupied && !visited)
 				c = '*';
-			else if (!cell.Occupied && cell.Visited)
+			else if (!cell.Occupied && visited)
 				c = 'X';
 			else if (!cell.Occupied && cell.Diagonal)
 				c = '/';
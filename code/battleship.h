@@ -3,6 +3,8 @@
 
 #include "simulator.h"
 #include "grid.h"
+#include "copyonwrite.h"
+#include <bitset>
 #include <list>
 
 struct SHIP
@@ -19,11 +21,16 @@ public:
 	struct CELL
 	{
 		bool Occupied;
-		bool Visited;
 		bool Diagonal;
 	};
 
-	GRID<CELL> Cells;
+	// One cell per action
+	static const int MaxCells = ACTION_SET::MaxActions;
+
+	// Ship layout is shared between copies until a hit or a local move
+	// changes it; the visited cells change on every step and are kept inline
+	COPY_ON_WRITE<GRID<CELL> > Cells;
+	std::bitset<MaxCells> Visited;
 	std::vector<SHIP> Ships;
 	int NumRemaining;
 };
@@ -42,9 +49,15 @@ public:
 		int& observation, double& reward) const;
 
 	void GenerateLegal(const STATE& state, const HISTORY& history,
-		std::vector<int>& legal, const STATUS& status) const;
+		ACTION_SET& legal, const STATUS& status) const;
 	virtual bool LocalMove(STATE& state, const HISTORY& history,
 		int stepObs, const STATUS& status) const;
+	virtual bool HasStateHash() const { return true; }
+	virtual uint64_t Hash(const STATE& state) const;
+	virtual bool Equal(const STATE& state1, const STATE& state2) const;
+
+	// Ships never move, so the state only depends on which cells were fired at
+	virtual bool HasCommutativeHistory() const { return true; }
 
 	virtual void DisplayBeliefs(const BELIEF_STATE& beliefState,
 		std::ostream& ostr) const;
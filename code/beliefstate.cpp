@@ -1,14 +1,25 @@
 #include "beliefstate.h"
 #include "simulator.h"
+#include "testsimulator.h"
 #include "utils.h"
+#include <string.h>
 
 using namespace UTILS;
 
 BELIEF_STATE::BELIEF_STATE()
+	: StateSize(0),
+	Compressed(false),
+	NumParticles(0)
 {
 	Samples.clear();
 }
 
+void BELIEF_STATE::SetCompressed(bool compressed)
+{
+	assert(Empty());
+	Compressed = compressed;
+}
+
 void BELIEF_STATE::Free(const SIMULATOR& simulator)
 {
 	for (std::vector<STATE*>::iterator i_state = Samples.begin();
@@ -17,47 +28,250 @@ void BELIEF_STATE::Free(const SIMULATOR& simulator)
 		simulator.FreeState(*i_state);
 	}
 	Samples.clear();
+	Values.clear();
+	Scenarios.Clear();
+	Multiplicity.clear();
+	Index.clear();
+	Cumulative.clear();
+	NumParticles = 0;
+	Compressed = false;
 }
 
 STATE* BELIEF_STATE::CreateSample(const SIMULATOR& simulator) const
 {
-	int index = Random(Samples.size());
-	STATE* original = Samples[index];
-	STATE* copyState = simulator.Copy(*Samples[index]);
+	int index = Compressed ? SampleIndex() : Random(GetNumSamples());
+	const STATE* original = GetSample(index);
+	STATE* copyState = simulator.Copy(*original);
 	copyState->ScenarioId = original->ScenarioId;
 	return copyState;
 }
 
-void BELIEF_STATE::AddSample(STATE* state)
+// Draws a stored state in proportion to its multiplicity, the running totals
+// are rebuilt after the belief state has changed
+int BELIEF_STATE::SampleIndex() const
+{
+	if (Cumulative.size() != Multiplicity.size())
+	{
+		Cumulative.resize(Multiplicity.size());
+		int total = 0;
+		for (int i = 0; i < (int) Multiplicity.size(); i++)
+			Cumulative[i] = total += Multiplicity[i];
+	}
+	int particle = Random(NumParticles);
+	return std::upper_bound(Cumulative.begin(), Cumulative.end(), particle)
+		- Cumulative.begin();
+}
+
+void BELIEF_STATE::SetStorage(const SIMULATOR& simulator)
+{
+	if (Empty())
+		StateSize = simulator.GetStateSize();
+	assert(StateSize == simulator.GetStateSize());
+}
+
+void BELIEF_STATE::AddSample(STATE* state, const SIMULATOR& simulator)
+{
+	SetStorage(simulator);
+	Scenarios.Add(state->ScenarioId, 1);
+	if (Compressed && Merge(*state, 1, simulator))
+		simulator.FreeState(state);
+	else if (StateSize)
+	{
+		Store(*state, simulator);
+		simulator.FreeState(state);
+	}
+	else
+		Samples.push_back(state);
+}
+
+void BELIEF_STATE::AddCopy(const STATE& state, const SIMULATOR& simulator)
+{
+	SetStorage(simulator);
+	Add(state, 1, simulator);
+}
+
+void BELIEF_STATE::Add(const STATE& state, int count, const SIMULATOR& simulator)
+{
+	Scenarios.Add(state.ScenarioId, count);
+	Insert(state, count, simulator);
+}
+
+// Stores count copies of state without touching the scenario counts
+void BELIEF_STATE::Insert(const STATE& state, int count, const SIMULATOR& simulator)
+{
+	if (Compressed)
+	{
+		if (!Merge(state, count, simulator))
+			Store(state, simulator);
+		return;
+	}
+	for (int n = 0; n < count; n++)
+		Store(state, simulator);
+}
+
+void BELIEF_STATE::Store(const STATE& state, const SIMULATOR& simulator)
 {
-	Samples.push_back(state);
+	if (StateSize)
+	{
+		const char* bytes = reinterpret_cast<const char*>(&state);
+		Values.insert(Values.end(), bytes, bytes + StateSize);
+	}
+	else
+		Samples.push_back(simulator.Copy(state));
 }
 
-int BELIEF_STATE::GetNumScenarios() const
+// Adds count to an equal stored state if there is one. Otherwise records
+// the state as the next distinct sample, which the caller then stores.
+// Scenario ids are not part of the key, equal particles from different
+// start states merge and only Scenarios keeps them apart
+bool BELIEF_STATE::Merge(const STATE& state, int count, const SIMULATOR& simulator)
 {
-	std::unordered_set<int> scenarioIds;
-	for(int index = 0; index < Samples.size(); index)
+	uint64_t hash = simulator.Hash(state);
+	typedef std::unordered_multimap<uint64_t, int>::const_iterator ITERATOR;
+	std::pair<ITERATOR, ITERATOR> range = Index.equal_range(hash);
+	for (ITERATOR i_entry = range.first; i_entry != range.second; ++i_entry)
 	{
-		scenarioIds.insert(Samples[index]->ScenarioId);
+		const STATE& stored = *GetSample(i_entry->second);
+		if (simulator.Equal(stored, state))
+		{
+			Multiplicity[i_entry->second] += count;
+			NumParticles += count;
+			Cumulative.clear();
+			return true;
+		}
 	}
-	return scenarioIds.size();
+	Index.insert(std::make_pair(hash, (int) Multiplicity.size()));
+	Multiplicity.push_back(count);
+	NumParticles += count;
+	Cumulative.clear();
+	return false;
 }
 
-void BELIEF_STATE::Copy(const BELIEF_STATE& beliefs, const SIMULATOR& simulator)
+void BELIEF_STATE::Copy(const BELIEF_STATE& beliefs, const SIMULATOR& simulator,
+	int numSamples)
 {
+	if (beliefs.Empty())
+		return;
+	SetStorage(simulator);
+	if (numSamples < 0 || numSamples > beliefs.GetNumSamples())
+		numSamples = beliefs.GetNumSamples();
+	if (numSamples < beliefs.GetNumSamples())
+	{
+		for (int i = 0; i < numSamples; i++)
+			Add(*beliefs.GetSample(i), beliefs.GetMultiplicity(i), simulator);
+		return;
+	}
+	Scenarios.Add(beliefs.Scenarios);
+	if (Compressed || beliefs.Compressed)
+	{
+		for (int i = 0; i < numSamples; i++)
+			Insert(*beliefs.GetSample(i), beliefs.GetMultiplicity(i), simulator);
+		return;
+	}
+	if (StateSize)
+	{
+		Values.insert(Values.end(), beliefs.Values.begin(), beliefs.Values.end());
+		return;
+	}
 	for (std::vector<STATE*>::const_iterator i_state = beliefs.Samples.begin();
 		i_state != beliefs.Samples.end(); ++i_state)
 	{
-		AddSample(simulator.Copy(**i_state));
+		Samples.push_back(simulator.Copy(**i_state));
 	}
 }
 
 void BELIEF_STATE::Move(BELIEF_STATE& beliefs)
 {
+	assert(!Compressed && !beliefs.Compressed);
+	if (Empty())
+		StateSize = beliefs.StateSize;
+	assert(beliefs.Empty() || StateSize == beliefs.StateSize);
+	Scenarios.Add(beliefs.Scenarios);
+	beliefs.Scenarios.Clear();
+	Values.insert(Values.end(), beliefs.Values.begin(), beliefs.Values.end());
+	beliefs.Values.clear();
 	for (std::vector<STATE*>::const_iterator i_state = beliefs.Samples.begin();
 		i_state != beliefs.Samples.end(); ++i_state)
 	{
-		AddSample(*i_state);
+		Samples.push_back(*i_state);
 	}
 	beliefs.Samples.clear();
 }
+
+void BELIEF_STATE::AddResampled(const std::vector<STATE*>& states,
+	const std::vector<double>& weights, int numSamples,
+	const SIMULATOR& simulator)
+{
+	assert(states.size() == weights.size() && !states.empty());
+	double totalWeight = 0;
+	for (std::vector<double>::const_iterator i_weight = weights.begin();
+		i_weight != weights.end(); ++i_weight)
+		totalWeight += *i_weight;
+
+	// One random offset, then evenly spaced pointers into the cumulative weights
+	double spacing = totalWeight / numSamples;
+	double pointer = RandomDouble(0, spacing);
+	double cumulative = weights[0];
+	int index = 0;
+	for (int n = 0; n < numSamples; ++n, pointer += spacing)
+	{
+		while (pointer > cumulative && index + 1 < (int) states.size())
+			cumulative += weights[++index];
+		AddCopy(*states[index], simulator);
+	}
+}
+
+void BELIEF_STATE::AddResampled(const BELIEF_STATE& beliefs, int numSamples,
+	const SIMULATOR& simulator)
+{
+	assert(!beliefs.Empty());
+	SetStorage(simulator);
+
+	// Every particle has the same weight, so a single pass over the stored
+	// states counts how many evenly spaced pointers fall into each of them
+	double spacing = (double) beliefs.GetNumParticles() / numSamples;
+	double pointer = RandomDouble(0, spacing);
+	int cumulative = 0, added = 0;
+	const int last = beliefs.GetNumSamples() - 1;
+	for (int i = 0; i <= last; i++)
+	{
+		cumulative += beliefs.GetMultiplicity(i);
+		int count = 0;
+		for (; pointer < cumulative && added + count < numSamples; pointer += spacing)
+			count++;
+		if (i == last) // guards against rounding in the pointer sum
+			count = numSamples - added;
+		if (count)
+			Add(*beliefs.GetSample(i), count, simulator);
+		added += count;
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void BELIEF_STATE::UnitTest()
+{
+	// Equal particles from different start states collapse into one entry,
+	// while every scenario is still counted
+	TEST_SIMULATOR testSimulator(2, 2, 1);
+	BELIEF_STATE beliefs;
+	beliefs.SetCompressed(true);
+	for (int i = 0; i < 4; i++)
+	{
+		STATE* state = testSimulator.CreateStartState();
+		state->ScenarioId = i;
+		beliefs.AddSample(state, testSimulator);
+	}
+	assert(beliefs.GetNumSamples() == 1);
+	assert(beliefs.GetMultiplicity(0) == 4);
+	assert(beliefs.GetNumParticles() == 4);
+	assert(beliefs.GetNumScenarios() == 4);
+	assert(beliefs.GetScenarioCount(2) == 1);
+
+	BELIEF_STATE copy;
+	copy.SetCompressed(true);
+	copy.Copy(beliefs, testSimulator);
+	assert(copy.GetNumSamples() == 1 && copy.GetNumScenarios() == 4);
+	copy.Free(testSimulator);
+	beliefs.Free(testSimulator);
+}
@@ -2,17 +2,60 @@
 #define BELIEF_STATE_H
 
 #include <vector>
-#include <unordered_set>
+#include <unordered_map>
+#include <stdint.h>
 
 class STATE;
 class SIMULATOR;
 
+//-----------------------------------------------------------------------------
+// Number of particles per scenario id. Each start state is its own scenario,
+// so a belief state may hold as many scenarios as particles. The counts are
+// kept apart from the stored states, which merge regardless of scenario
+
+class SCENARIO_COUNTS
+{
+public:
+
+	void Add(int scenarioId, int count)
+	{
+		Counts[scenarioId] += count;
+	}
+
+	void Add(const SCENARIO_COUNTS& counts)
+	{
+		for (std::unordered_map<int, int>::const_iterator i_entry = counts.Counts.begin();
+			i_entry != counts.Counts.end(); ++i_entry)
+			Add(i_entry->first, i_entry->second);
+	}
+
+	int GetCount(int scenarioId) const
+	{
+		std::unordered_map<int, int>::const_iterator i_entry = Counts.find(scenarioId);
+		return i_entry == Counts.end() ? 0 : i_entry->second;
+	}
+
+	void Clear() { Counts.clear(); }
+	int GetNumScenarios() const { return Counts.size(); }
+
+private:
+
+	std::unordered_map<int, int> Counts;
+};
+
+//-----------------------------------------------------------------------------
+
 class BELIEF_STATE
 {
 public:
 
 	BELIEF_STATE();
 
+	// Store equal states once with a multiplicity, needs a simulator that
+	// implements state hashing. Must be set while the belief state is empty
+	void SetCompressed(bool compressed);
+	bool IsCompressed() const { return Compressed; }
+
 	// Free memory for all states
 	void Free(const SIMULATOR& simulator);
 
@@ -20,22 +63,80 @@ public:
 	STATE* CreateSample(const SIMULATOR& simulator) const;
 
 	// Added state is owned by belief state
-	void AddSample(STATE* state);
+	void AddSample(STATE* state, const SIMULATOR& simulator);
 
-	// Make own copies of all samples
-	void Copy(const BELIEF_STATE& beliefs, const SIMULATOR& simulator);
+	// Adds a copy of state, caller keeps ownership
+	void AddCopy(const STATE& state, const SIMULATOR& simulator);
 
-	// Move all samples into this belief state
+	// Make own copies of all samples, or of the first numSamples
+	void Copy(const BELIEF_STATE& beliefs, const SIMULATOR& simulator,
+		int numSamples = -1);
+
+	// Move all samples into this belief state, neither may be compressed
 	void Move(BELIEF_STATE& beliefs);
 
-	bool Empty() const { return Samples.empty(); }
-	int GetNumSamples() const { return Samples.size(); }
-	int GetNumScenarios() const;
-	const STATE* GetSample(int index) const { return Samples[index]; }
+	// Add copies of weighted states, drawn by systematic resampling
+	void AddResampled(const std::vector<STATE*>& states,
+		const std::vector<double>& weights, int numSamples,
+		const SIMULATOR& simulator);
+
+	// Add copies of the particles in beliefs, drawn by systematic resampling
+	void AddResampled(const BELIEF_STATE& beliefs, int numSamples,
+		const SIMULATOR& simulator);
+
+	bool Empty() const { return Samples.empty() && Values.empty(); }
+	int GetNumSamples() const
+	{
+		return StateSize ? Values.size() / StateSize : Samples.size();
+	}
+	int GetNumScenarios() const { return Scenarios.GetNumScenarios(); }
+	int GetScenarioCount(int scenarioId) const
+	{
+		return Scenarios.GetCount(scenarioId);
+	}
+
+	// Samples are the distinct stored states when compressed, each standing
+	// for GetMultiplicity particles
+	int GetMultiplicity(int index) const
+	{
+		return Compressed ? Multiplicity[index] : 1;
+	}
+	int GetNumParticles() const
+	{
+		return Compressed ? NumParticles : GetNumSamples();
+	}
+
+	const STATE* GetSample(int index) const
+	{
+		if (StateSize)
+			return reinterpret_cast<const STATE*>(&Values[index * StateSize]);
+		return Samples[index];
+	}
+
+	static void UnitTest();
 
 private:
 
+	void SetStorage(const SIMULATOR& simulator);
+	void Add(const STATE& state, int count, const SIMULATOR& simulator);
+	void Insert(const STATE& state, int count, const SIMULATOR& simulator);
+	void Store(const STATE& state, const SIMULATOR& simulator);
+	bool Merge(const STATE& state, int count, const SIMULATOR& simulator);
+	int SampleIndex() const;
+
+	// Trivially copyable states are stored by value in one contiguous block,
+	// all other states as pointers to simulator allocated states
 	std::vector<STATE*> Samples;
+	std::vector<char> Values;
+	int StateSize;
+	SCENARIO_COUNTS Scenarios;
+
+	// Compressed storage, with stored states indexed by their hash
+	bool Compressed;
+	std::vector<int> Multiplicity;
+	std::unordered_multimap<uint64_t, int> Index;
+	int NumParticles;
+	mutable std::vector<int> Cumulative;
 };
 
 #endif // BELIEF_STATE_H
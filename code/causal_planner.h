@@ -42,25 +42,6 @@ public:
         counterfactualBandit->reset();
     }
 
-	POOLTSNode* getNext(const int action, std::list<POOLTSNode*>& pool)
-    {
-        POOLTSNode* child = children[action];
-		if(child == NULL)
-		{
-			if(!pool.empty())
-			{
-				child = pool.front();
-			pool.pop_front();
-			}
-			else
-			{
-				child = new CounterfactualPOOLTSNode(Simulator, Params);
-			}
-			children[action] = child;
-		}
-		return child;
-    }
-
 private:
     MABUC* counterfactualBandit;
 };
@@ -73,12 +54,15 @@ class CORAL : public POOLTS
 {
 public:
     CORAL(const SIMULATOR& simulator, const PARAMS& params) : POOLTS(simulator, params)
-    {
-    	this->rootNode = new CounterfactualPOOLTSNode(simulator, params);
-    }
+    {}
     virtual ~CORAL()
     {}
-    virtual double Simulate(STATE& state, POOLTSNode* node, int t);
+    virtual int SelectTreeAction(STATE& state, POOLTSNode* node, int t);
+protected:
+    virtual POOLTSNode* CreateNode()
+    {
+        return new CounterfactualPOOLTSNode(Simulator, Params);
+    }
 };
 
 /**
@@ -89,31 +73,13 @@ class COURAGENode : public POOLTSNode
 public:
     COURAGENode(const SIMULATOR& simulator, const MCTS::PARAMS& params) : POOLTSNode(simulator, params)
     {
+		delete this->bandit;
 		this->bandit = new CausalUCB(numberOfActions, 1, simulator.GetRewardRange(), int(params.NumSimulations*params.IntuitionLearningRatio));
     }
 
     ~COURAGENode()
     {
     }
-
-	POOLTSNode* getNext(const int action, std::list<POOLTSNode*>& pool)
-    {
-        POOLTSNode* child = children[action];
-		if(child == NULL)
-		{
-			if(!pool.empty())
-			{
-				child = pool.front();
-			pool.pop_front();
-			}
-			else
-			{
-				child = new COURAGENode(Simulator, Params);
-			}
-			children[action] = child;
-		}
-		return child;
-    }
 };
 
 /**
@@ -124,29 +90,18 @@ class COURAGE : public POOLTS
 {
 public:
     COURAGE(const SIMULATOR& simulator, const PARAMS& params) : POOLTS(simulator, params)
-    {
-    	this->rootNode = new COURAGENode(simulator, params);
-    }
+    {}
     virtual ~COURAGE()
     {}
-    virtual double Simulate(STATE& state, POOLTSNode* node, int t)
+
+    virtual int SelectTreeAction(STATE& state, POOLTSNode* node, int t)
     {
-        std::vector<int> legal;
+        ACTION_SET legal, heuristic;
         Simulator.GenerateLegal(state, GetHistory(), legal, GetStatus());
-        std::vector<int> heuristic;
         if(Params.HumanKnowledge)
         {
             Simulator.GeneratePreferred(state, GetHistory(), heuristic, GetStatus());
         }
-        else
-        {
-            heuristic = legal;
-        }
-
-        if(heuristic.empty())
-        {
-            heuristic = legal;
-        }
         int action;
         Bandit* bandit = node->getBandit();
         if(bandit->isWarmingUp())
@@ -157,42 +112,11 @@ public:
         {
             action = bandit->sampleFrom(legal);
         }
-        PeakTreeDepth = TreeDepth;
-        if (t >= Params.MaxDepth)
-        {
-            return 0;
-        }
-        bool isLeaf = node->IsLeaf();
-        if(isLeaf)
-        {
-            node->Expand();
-            IncrementNodeCountBy(Simulator.GetNumActions());
-        }
-        int observation;
-        double immediateReward, delayedReward = 0;
-        bool terminal = Simulator.Step(state, action, observation, immediateReward);
-        if(t == 0)
-        {
-            VNODE*& vnode = Root->Child(action).Child(observation);
-            if (!vnode && !terminal) {
-                vnode = ExpandNode(&state);
-                AddSample(vnode, state);
-        }
-        }
-        History.Add(action, observation);
-        if(terminal)
-        {
-            node->Update(immediateReward);
-            return immediateReward;
-        }
-        assert(observation >= 0 && observation < Simulator.GetNumObservations());
-
-        TreeDepth++;
-        delayedReward = isLeaf? Rollout(state) : Simulate(state, node->getNext(action, pool), t+1);
-        TreeDepth--;
-
-        double totalReward = immediateReward + Simulator.GetDiscount() * delayedReward;
-        node->Update(totalReward);
-        return totalReward;
+        return action;
+    }
+protected:
+    virtual POOLTSNode* CreateNode()
+    {
+        return new COURAGENode(Simulator, Params);
     }
 };
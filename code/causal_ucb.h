@@ -46,7 +46,7 @@ public:
 		warmupPhase = max(0, warmupPhase - 1);
 	}
 
-	virtual int sampleArmFrom(const std::vector<int>& legalArms)
+	virtual int sampleArmFrom(const ACTION_SET& legalArms)
 	{
 		if(warmupPhase > 0 || noHeuristic)
 		{
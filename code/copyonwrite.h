@@ -0,0 +1,42 @@
+#ifndef COPY_ON_WRITE_H
+#define COPY_ON_WRITE_H
+
+#include <assert.h>
+#include <memory>
+
+//-----------------------------------------------------------------------------
+// Shared handle to a large part of a state. Copying a state only copies the
+// handle; the data is cloned the first time a state with shared data asks
+// to modify it. Reference counts are atomic, so states sharing data may be
+// copied and stepped on different threads.
+
+template <class T>
+class COPY_ON_WRITE
+{
+public:
+
+	const T& Get() const
+	{
+		assert(Data);
+		return *Data;
+	}
+
+	T& Modify()
+	{
+		if (!Data)
+			Data = std::make_shared<T>();
+		else if (Data.use_count() > 1)
+			Data = std::make_shared<T>(*Data);
+		return *Data;
+	}
+
+	// Drops this handle's reference, used when a state is returned to a
+	// memory pool so that it does not keep shared data alive
+	void Release() { Data.reset(); }
+
+private:
+
+	std::shared_ptr<T> Data;
+};
+
+#endif // COPY_ON_WRITE_H
@@ -1,7 +1,46 @@
 #include "experiment.h"
 #include "boost/timer.hpp"
+#include <algorithm>
+#include <sstream>
 
 using namespace std;
+using namespace UTILS;
+
+//----------------------------------------------------------------------------
+// Real environment draws come from a stream keyed by the run and step while
+// in scope, so that every algorithm meets the same start states and the same
+// outcomes of equal actions. Planners keep drawing from their own generator
+
+class REAL_STREAM
+{
+public:
+
+	REAL_STREAM(const EXPERIMENT::PARAMS& params, int run, int step)
+		: Previous(ThreadGenerator),
+		Enabled(params.CommonRandomNumbers)
+	{
+		if (!Enabled)
+			return;
+		uint64_t key = HashCombine(HashCombine(params.Seed, run), step);
+		std::seed_seq seeds = { (uint32_t) key, (uint32_t) (key >> 32) };
+		Generator.seed(seeds);
+		ThreadGenerator = &Generator;
+	}
+
+	~REAL_STREAM()
+	{
+		if (Enabled)
+			ThreadGenerator = Previous;
+	}
+
+private:
+
+	std::mt19937 Generator;
+	std::mt19937* Previous;
+	bool Enabled;
+};
+
+//----------------------------------------------------------------------------
 
 EXPERIMENT::PARAMS::PARAMS()
 	: NumRuns(100),
@@ -15,6 +54,12 @@ EXPERIMENT::PARAMS::PARAMS()
 	Accuracy(0.01),
 	UndiscountedHorizon(1000),
 	AutoExploration(true),
+	BudgetSweep(false),
+	CommonRandomNumbers(false),
+	Seed(0),
+	TargetHalfWidth(0),
+	MinRuns(10),
+	BatchSize(10),
 	AlgorithmName("MCTS")
 {
 }
@@ -27,8 +72,13 @@ EXPERIMENT::EXPERIMENT(const SIMULATOR& real,
 	OutputFile(outputFile.c_str()),
 	NodeCountFile(nodeCountFile),
 	ExpParams(expParams),
-	SearchParams(searchParams)
+	SearchParams(searchParams),
+	RunIndex(0)
 {
+	// Paired differences only reduce variance on common random numbers
+	if (!ExpParams.BaselineAlgorithm.empty())
+		ExpParams.CommonRandomNumbers = true;
+
 	if (ExpParams.AutoExploration)
 	{
 		if (SearchParams.UseRave)
@@ -36,44 +86,89 @@ EXPERIMENT::EXPERIMENT(const SIMULATOR& real,
 		else
 			SearchParams.ExplorationConstant = simulator.GetRewardRange();
 	}
-	MCTS::InitFastUCB(SearchParams.ExplorationConstant);
 }
 
-void EXPERIMENT::Run()
+MCTS* EXPERIMENT::CreatePlanner(const std::string& algorithmName)
 {
-	boost::timer timer;
-
 	MCTS* mcts = NULL;
-	if(ExpParams.AlgorithmName == "POOLTS")
+	if(algorithmName == "POOLTS")
 	{
 		mcts = new POOLTS(Simulator, SearchParams);
 	}
-	else if(ExpParams.AlgorithmName == "POSTS")
+	else if(algorithmName == "POSTS")
 	{
 		mcts = new POSTS(Simulator, SearchParams);
 	}
-	else if(ExpParams.AlgorithmName == "CORAL")
+	else if(algorithmName == "CORAL")
 	{
 		mcts = new CORAL(Simulator, SearchParams);
 	}
-	else if(ExpParams.AlgorithmName == "POMCPOW")
+	else if(algorithmName == "POMCPOW")
 	{
-		SearchParams.kObservations = 4.0;
-		SearchParams.alphaObservations = 1.0/35.0;
-		mcts = new MCTS(Simulator, SearchParams);
+		// Widening settings stay local, so that a paired baseline is unaffected
+		MCTS::PARAMS params = SearchParams;
+		params.kObservations = 4.0;
+		params.alphaObservations = 1.0/35.0;
+		mcts = new MCTS(Simulator, params);
 	}
 	else
 	{
 		mcts = new MCTS(Simulator, SearchParams);
 	}
-    double undiscountedReturn = 0.0;
-	double discountedReturn = 0.0;
+	return mcts;
+}
+
+void EXPERIMENT::Run()
+{
+	double undiscountedReturn, discountedReturn;
+	RunEpisode(ExpParams.AlgorithmName, Results, undiscountedReturn, discountedReturn);
+	if (!ExpParams.BaselineAlgorithm.empty())
+	{
+		double baselineUndiscounted, baselineDiscounted;
+		RunEpisode(ExpParams.BaselineAlgorithm, BaselineResults,
+			baselineUndiscounted, baselineDiscounted);
+		Results.UndiscountedDifference.Add(undiscountedReturn - baselineUndiscounted);
+		Results.DiscountedDifference.Add(discountedReturn - baselineDiscounted);
+		cout << "Paired difference to " << ExpParams.BaselineAlgorithm << " = "
+			<< Results.UndiscountedDifference.GetMean() << " +- "
+			<< Results.UndiscountedDifference.GetStdErr() << endl;
+	}
+
+	WriteNodeCount(NodeCountFile, SearchParams.NumSimulations, Results);
+}
+
+// One row of the node count file, with the results of all runs so far
+void EXPERIMENT::WriteNodeCount(std::ostream& ostr, int numSimulations,
+	const RESULTS& results) const
+{
+	ostr << numSimulations << "\t"
+			<< results.UndiscountedReturn.GetMean() << "\t"
+			<< results.UndiscountedReturn.GetStdErr() << "\t"
+			<< results.DiscountedReturn.GetMean() << "\t"
+			<< results.DiscountedReturn.GetStdErr() << "\t"
+			<< results.NodeCount.GetMean() << "\t"
+			<< results.NodeCount.GetStdErr() << "\t"
+            << results.Time.GetMean() << endl;
+}
+
+void EXPERIMENT::RunEpisode(const std::string& algorithmName, RESULTS& results,
+	double& undiscountedReturn, double& discountedReturn)
+{
+	boost::timer timer;
+
+	MCTS* mcts = CreatePlanner(algorithmName);
+	undiscountedReturn = 0.0;
+	discountedReturn = 0.0;
 	double discount = 1.0;
 	bool terminal = false;
 	bool outOfParticles = false;
 	int t;
 
-	STATE* state = Real.CreateStartState();
+	STATE* state;
+	{
+		REAL_STREAM stream(ExpParams, RunIndex, 0);
+		state = Real.CreateStartState();
+	}
 	if (SearchParams.Verbose >= 1)
 		Real.DisplayState(*state, cout);
 
@@ -82,9 +177,13 @@ void EXPERIMENT::Run()
 		int observation;
 		double reward;
 		int action = mcts->SelectAction();
-		terminal = Real.Step(*state, action, observation, reward);
+		mcts->StartPondering(action);
+		{
+			REAL_STREAM stream(ExpParams, RunIndex, t + 1);
+			terminal = Real.Step(*state, action, observation, reward);
+		}
 
-		Results.Reward.Add(reward);
+		results.Reward.Add(reward);
         undiscountedReturn += reward;
 		discountedReturn += reward * discount;
 		discount *= Real.GetDiscount();
@@ -108,64 +207,226 @@ void EXPERIMENT::Run()
 		if (timer.elapsed() > ExpParams.TimeOut)
 		{
 			cout << "Timed out after " << t << " steps in "
-				<< Results.Time.GetTotal() << "seconds" << endl;
+				<< results.Time.GetTotal() << "seconds" << endl;
 			break;
 		}
 	}
+	mcts->StopPondering();
 
 	if (outOfParticles)
+		FinishRandom(*state, mcts->GetHistory(), mcts->GetStatus(), t,
+			results, undiscountedReturn, discountedReturn, discount);
+
+	results.Time.Add(timer.elapsed());
+	results.UndiscountedReturn.Add(undiscountedReturn);
+	results.DiscountedReturn.Add(discountedReturn);
+	results.NodeCount.Add(mcts->GetMeanNodeCount());
+	cout << "Discounted return = " << discountedReturn
+		<< ", average = " << results.DiscountedReturn.GetMean() << endl;
+	cout << "Undiscounted return = " << undiscountedReturn
+		<< ", average = " << results.UndiscountedReturn.GetMean() << endl;
+	delete mcts;
+}
+
+// Finishes an episode from step t with random actions, once the planner
+// has run out of particles
+void EXPERIMENT::FinishRandom(STATE& state, HISTORY history,
+	const SIMULATOR::STATUS& status, int t, RESULTS& results,
+	double& undiscountedReturn, double& discountedReturn, double& discount)
+{
+	cout << "Out of particles, finishing episode with SelectRandom" << endl;
+	while (++t < ExpParams.NumSteps)
 	{
-		cout << "Out of particles, finishing episode with SelectRandom" << endl;
-		HISTORY history = mcts->GetHistory();
-		while (++t < ExpParams.NumSteps)
+		int observation;
+		double reward;
+
+		// This passes real state into simulator!
+		// SelectRandom must only use fully observable state
+		// to avoid "cheating"
+		int action = Simulator.SelectRandom(state, history, status);
+		bool terminal;
 		{
-			int observation;
-			double reward;
+			REAL_STREAM stream(ExpParams, RunIndex, t + 1);
+			terminal = Real.Step(state, action, observation, reward);
+		}
 
-			// This passes real state into simulator!
-			// SelectRandom must only use fully observable state
-			// to avoid "cheating"
-			int action = Simulator.SelectRandom(*state, history, mcts->GetStatus());
-			terminal = Real.Step(*state, action, observation, reward);
+		results.Reward.Add(reward);
+		undiscountedReturn += reward;
+		discountedReturn += reward * discount;
+		discount *= Real.GetDiscount();
+		if (SearchParams.Verbose >= 1)
+		{
+			Real.DisplayAction(action, cout);
+			Real.DisplayState(state, cout);
+			Real.DisplayObservation(state, observation, cout);
+			Real.DisplayReward(reward, cout);
+		}
+
+		if (terminal)
+		{
+			cout << "Terminated" << endl;
+			break;
+		}
+
+		history.Add(action, observation);
+	}
+}
 
-			Results.Reward.Add(reward);
-			undiscountedReturn += reward;
-			discountedReturn += reward * discount;
-			discount *= Real.GetDiscount();
-			if (SearchParams.Verbose >= 1)
+// One episode for every budget from 2^MinDoubles to 2^MaxDoubles. Budgets
+// whose episodes have followed the same actions share one real state and
+// one search, which records the greedy action at each budget. Where their
+// actions differ the episode forks, and each branch continues with a search
+// sized for its largest budget. Each budget gets the beliefs and is charged
+// the search time that a search of its own size would have had
+void EXPERIMENT::SweepRun(std::vector<RESULTS>& results)
+{
+	boost::timer timer;
+	std::vector<double> times(results.size(), 0.0);
+	std::vector<double> nodeCounts(results.size(), 0.0);
+
+	struct BRANCH
+	{
+		std::vector<int> Doubles;
+		STATE* State;
+		BELIEF_STATE Beliefs;
+		HISTORY History;
+		double UndiscountedReturn, DiscountedReturn, Discount;
+	};
+
+	MCTS* mcts = CreatePlanner(ExpParams.AlgorithmName);
+	std::vector<BRANCH> branches(1), nextBranches;
+	for (int i = ExpParams.MinDoubles; i <= ExpParams.MaxDoubles; i++)
+		branches[0].Doubles.push_back(i);
+	{
+		REAL_STREAM stream(ExpParams, RunIndex, 0);
+		branches[0].State = Real.CreateStartState();
+	}
+	branches[0].Beliefs.Copy(mcts->BeliefState(), Simulator);
+	branches[0].UndiscountedReturn = 0.0;
+	branches[0].DiscountedReturn = 0.0;
+	branches[0].Discount = 1.0;
+
+	std::vector<BRANCH> ended;
+	for (int t = 0; !branches.empty(); t++)
+	{
+		nextBranches.clear();
+		for (std::vector<BRANCH>::iterator i_branch = branches.begin();
+			i_branch != branches.end(); ++i_branch)
+		{
+			// Nodes of the new root count towards every budget, as the root
+			// created by Update does in a separate run
+			int rootNodeCount = mcts->GetNodeCount();
+			mcts->SetRoot(i_branch->Beliefs, i_branch->History);
+			rootNodeCount = mcts->GetNodeCount() - rootNodeCount;
+			mcts->SetNumSimulations(1 << i_branch->Doubles.back());
+			mcts->SelectAction();
+			const std::vector<int>& actions = mcts->GetCheckpointActions();
+			const std::vector<double>& searchTimes = mcts->GetCheckpointTimes();
+			const std::vector<int>& searchNodeCounts = mcts->GetCheckpointNodeCounts();
+			for (std::vector<int>::iterator i_doubles = i_branch->Doubles.begin();
+				i_doubles != i_branch->Doubles.end(); ++i_doubles)
+			{
+				times[*i_doubles - ExpParams.MinDoubles] += searchTimes[*i_doubles];
+				nodeCounts[*i_doubles - ExpParams.MinDoubles] +=
+					rootNodeCount + searchNodeCounts[*i_doubles];
+			}
+
+			// Group the budgets by their action, keeping budgets in order
+			std::vector<BRANCH> forks;
+			for (std::vector<int>::iterator i_doubles = i_branch->Doubles.begin();
+				i_doubles != i_branch->Doubles.end(); ++i_doubles)
 			{
-				Real.DisplayAction(action, cout);
-				Real.DisplayState(*state, cout);
-				Real.DisplayObservation(*state, observation, cout);
-				Real.DisplayReward(reward, cout);
+				int action = actions[*i_doubles];
+				std::vector<BRANCH>::iterator i_fork = forks.begin();
+				while (i_fork != forks.end()
+					&& actions[i_fork->Doubles[0]] != action)
+					++i_fork;
+				if (i_fork == forks.end())
+				{
+					forks.push_back(*i_branch);
+					forks.back().Doubles.clear();
+					i_fork = forks.end() - 1;
+				}
+				i_fork->Doubles.push_back(*i_doubles);
 			}
 
-			if (terminal)
+			// Copy the real state before the first fork steps it
+			for (std::vector<BRANCH>::iterator i_fork = forks.begin() + 1;
+				i_fork != forks.end(); ++i_fork)
+				i_fork->State = Real.Copy(*i_branch->State);
+
+			for (std::vector<BRANCH>::iterator i_fork = forks.begin();
+				i_fork != forks.end(); ++i_fork)
 			{
-				cout << "Terminated" << endl;
-				break;
+				int action = actions[i_fork->Doubles[0]];
+				int observation;
+				double reward;
+				bool terminal;
+				{
+					REAL_STREAM stream(ExpParams, RunIndex, t + 1);
+					terminal = Real.Step(*i_fork->State, action, observation, reward);
+				}
+
+				i_fork->UndiscountedReturn += reward;
+				i_fork->DiscountedReturn += reward * i_fork->Discount;
+				i_fork->Discount *= Real.GetDiscount();
+
+				if (terminal || t + 1 >= ExpParams.NumSteps)
+				{
+					ended.push_back(*i_fork);
+					continue;
+				}
+
+				// The belief update is shared by the budgets of this fork
+				boost::timer updateTimer;
+				bool updated = mcts->NextBeliefs(action, observation,
+					i_fork->Beliefs, i_fork->Doubles.back());
+				double updateTime = updateTimer.elapsed();
+				for (std::vector<int>::iterator i_doubles = i_fork->Doubles.begin();
+					i_doubles != i_fork->Doubles.end(); ++i_doubles)
+					times[*i_doubles - ExpParams.MinDoubles] += updateTime;
+
+				if (!updated)
+				{
+					// Step rewards are not kept per budget, only the returns
+					RESULTS scratch;
+					i_fork->History.Add(action, observation);
+					FinishRandom(*i_fork->State, i_fork->History, mcts->GetStatus(), t,
+						scratch, i_fork->UndiscountedReturn, i_fork->DiscountedReturn, i_fork->Discount);
+					ended.push_back(*i_fork);
+				}
+				else
+				{
+					i_fork->History.Add(action, observation);
+					nextBranches.push_back(*i_fork);
+				}
 			}
+		}
+		branches.swap(nextBranches);
 
-			history.Add(action, observation);
+		if (timer.elapsed() > ExpParams.TimeOut)
+		{
+			cout << "Timed out after " << t << " steps" << endl;
+			ended.insert(ended.end(), branches.begin(), branches.end());
+			break;
 		}
 	}
 
-	Results.Time.Add(timer.elapsed());
-	Results.UndiscountedReturn.Add(undiscountedReturn);
-	Results.DiscountedReturn.Add(discountedReturn);
-	Results.NodeCount.Add(mcts->GetMeanNodeCount());
-	cout << "Discounted return = " << discountedReturn
-		<< ", average = " << Results.DiscountedReturn.GetMean() << endl;
-	cout << "Undiscounted return = " << undiscountedReturn
-		<< ", average = " << Results.UndiscountedReturn.GetMean() << endl;
-	NodeCountFile << SearchParams.NumSimulations << "\t"
-			<< Results.UndiscountedReturn.GetMean() << "\t"
-			<< Results.UndiscountedReturn.GetStdErr() << "\t"
-			<< Results.DiscountedReturn.GetMean() << "\t"
-			<< Results.DiscountedReturn.GetStdErr() << "\t"
-			<< Results.NodeCount.GetMean() << "\t"
-			<< Results.NodeCount.GetStdErr() << "\t"
-            << Results.Time.GetMean() << endl;
+	for (std::vector<BRANCH>::iterator i_branch = ended.begin();
+		i_branch != ended.end(); ++i_branch)
+	{
+		for (std::vector<int>::iterator i_doubles = i_branch->Doubles.begin();
+			i_doubles != i_branch->Doubles.end(); ++i_doubles)
+		{
+			RESULTS& result = results[*i_doubles - ExpParams.MinDoubles];
+			result.Time.Add(times[*i_doubles - ExpParams.MinDoubles]);
+			result.UndiscountedReturn.Add(i_branch->UndiscountedReturn);
+			result.DiscountedReturn.Add(i_branch->DiscountedReturn);
+			result.NodeCount.Add(nodeCounts[*i_doubles - ExpParams.MinDoubles]);
+		}
+		i_branch->Beliefs.Free(Simulator);
+		Real.FreeState(i_branch->State);
+	}
 	delete mcts;
 }
 
@@ -174,28 +435,67 @@ void EXPERIMENT::MultiRun()
 	int numberOfRuns = ExpParams.NumRuns;
 	for (int n = 0; n < numberOfRuns; n++)
 	{
+		RunIndex = n;
 		cout << "Starting run " << n + 1 << " with "
 			<< SearchParams.NumSimulations << " simulations... " << endl;
 		Run();
-		if (Results.Time.GetTotal() > ExpParams.TimeOut)
+		double totalTime = Results.Time.GetTotal() + BaselineResults.Time.GetTotal();
+		if (totalTime > ExpParams.TimeOut)
 		{
 			cout << "Timed out after " << n << " runs in "
-				<< Results.Time.GetTotal() << "seconds" << endl;
+				<< totalTime << "seconds" << endl;
+			break;
+		}
+		if (IsConverged(Results, n + 1))
+		{
+			cout << "Converged after " << n + 1 << " runs, undiscounted return = "
+				<< Results.UndiscountedReturn.GetMean() << " +- "
+				<< Results.UndiscountedReturn.GetStdErr() << endl;
 			break;
 		}
 	}
 }
 
+// Sequential stopping rule, only checked at the end of each batch of runs
+// so that the interval is not tested after every episode
+bool EXPERIMENT::IsConverged(const RESULTS& results, int numRuns) const
+{
+	static const double Z = 1.96;
+	const int batchSize = std::max(ExpParams.BatchSize, 1);
+	if (ExpParams.TargetHalfWidth <= 0 || numRuns < ExpParams.MinRuns
+		|| numRuns % batchSize != 0)
+		return false;
+
+	// With a baseline the paired difference is what is being estimated.
+	// Budget sweeps play no baseline, so they keep to the return
+	const STATISTIC& statistic = !ExpParams.BaselineAlgorithm.empty()
+		&& results.UndiscountedDifference.GetCount() > 0
+		? results.UndiscountedDifference : results.UndiscountedReturn;
+	return Z * statistic.GetStdErr() < ExpParams.TargetHalfWidth;
+}
+
 void EXPERIMENT::DiscountedReturn()
 {
 	cout << "Main runs" << endl;
-	OutputFile << "Simulations\tRuns\tUndiscounted return\tUndiscounted error\tDiscounted return\tDiscounted error\tNumberOfBandits\tNumberOfBandits error\tTime\n";
+	OutputFile << "Simulations\tRuns\tUndiscounted return\tUndiscounted error\tDiscounted return\tDiscounted error\tNumberOfBandits\tNumberOfBandits error\tTime";
+	if (!ExpParams.BaselineAlgorithm.empty())
+		OutputFile << "\tUndiscounted difference\tUndiscounted difference error\tDiscounted difference\tDiscounted difference error";
+	OutputFile << "\n";
 	NodeCountFile << "Simulations\tUndiscounted return\tUndiscounted error\tDiscounted return\tDiscounted error\tNumberOfBandits\tNumberOfBandits error\tTime\n";
 
 	//SearchParams.MaxDepth = Simulator.GetHorizon(ExpParams.Accuracy, ExpParams.UndiscountedHorizon);
 	ExpParams.SimSteps = Simulator.GetHorizon(ExpParams.Accuracy, ExpParams.UndiscountedHorizon);
 	ExpParams.NumSteps = Real.GetHorizon(ExpParams.Accuracy, ExpParams.UndiscountedHorizon);
 
+	// The sweep needs a planner that records checkpoints during UCTSearch
+	if (ExpParams.BudgetSweep && !SearchParams.DisableTree
+		&& ExpParams.AlgorithmName != "POOLTS" && ExpParams.AlgorithmName != "POSTS"
+		&& ExpParams.AlgorithmName != "CORAL")
+	{
+		DiscountedReturnSweep();
+		return;
+	}
+
 	for (int i = ExpParams.MinDoubles; i <= ExpParams.MaxDoubles; i++)
 	{
 		SearchParams.NumSimulations = 1 << i; // TODO Uncomment if large number of simulations required
@@ -207,6 +507,7 @@ void EXPERIMENT::DiscountedReturn()
 		SearchParams.MaxAttempts = SearchParams.NumTransforms * ExpParams.TransformAttempts;
 
 		Results.Clear();
+		BaselineResults.Clear();
 		MultiRun();
 
 		cout << "Simulations = " << SearchParams.NumSimulations << endl
@@ -224,7 +525,95 @@ void EXPERIMENT::DiscountedReturn()
 			<< Results.DiscountedReturn.GetStdErr() << "\t"
 			<< Results.NodeCount.GetMean() << "\t"
 			<< Results.NodeCount.GetStdErr() << "\t"
-            << Results.Time.GetMean() << endl;
+            << Results.Time.GetMean();
+		if (!ExpParams.BaselineAlgorithm.empty())
+		{
+			cout << "Paired undiscounted difference to " << ExpParams.BaselineAlgorithm
+				<< " = " << Results.UndiscountedDifference.GetMean()
+				<< " +- " << Results.UndiscountedDifference.GetStdErr() << endl;
+			OutputFile << "\t" << Results.UndiscountedDifference.GetMean()
+				<< "\t" << Results.UndiscountedDifference.GetStdErr()
+				<< "\t" << Results.DiscountedDifference.GetMean()
+				<< "\t" << Results.DiscountedDifference.GetStdErr();
+		}
+		OutputFile << endl;
+	}
+}
+
+// Same output as DiscountedReturn from one search per step. Particle and
+// transform counts are those of the largest budget for every budget, which
+// an independent run per budget would size to that budget instead
+void EXPERIMENT::DiscountedReturnSweep()
+{
+	const int maxDoubles = ExpParams.MaxDoubles;
+	SearchParams.NumSimulations = 1 << maxDoubles;
+	SearchParams.NumStartStates = 1 << maxDoubles;
+	if (maxDoubles + ExpParams.TransformDoubles >= 0)
+		SearchParams.NumTransforms = 1 << (maxDoubles + ExpParams.TransformDoubles);
+	else
+		SearchParams.NumTransforms = 1;
+	SearchParams.MaxAttempts = SearchParams.NumTransforms * ExpParams.TransformAttempts;
+	SearchParams.RecordCheckpoints = true;
+
+	cout << "Budget sweep: every budget uses " << SearchParams.NumStartStates
+		<< " start states and " << SearchParams.NumTransforms
+		<< " transforms of the largest budget" << endl;
+
+	// Node count rows are kept per budget and written in the order of
+	// separate runs, one row per run
+	std::vector<RESULTS> results(maxDoubles - ExpParams.MinDoubles + 1);
+	std::vector<std::ostringstream> nodeCountRows(results.size());
+	double totalTime = 0;
+	for (int n = 0; n < ExpParams.NumRuns; n++)
+	{
+		cout << "Starting sweep run " << n + 1 << " up to "
+			<< SearchParams.NumSimulations << " simulations... " << endl;
+		boost::timer timer;
+		RunIndex = n;
+		SweepRun(results);
+		totalTime += timer.elapsed();
+		for (int i = ExpParams.MinDoubles; i <= maxDoubles; i++)
+			WriteNodeCount(nodeCountRows[i - ExpParams.MinDoubles], 1 << i,
+				results[i - ExpParams.MinDoubles]);
+		if (totalTime > ExpParams.TimeOut)
+		{
+			cout << "Timed out after " << n << " runs in "
+				<< totalTime << "seconds" << endl;
+			break;
+		}
+
+		// Budgets share their runs, so stop once every budget has converged
+		bool converged = true;
+		for (std::vector<RESULTS>::const_iterator i_result = results.begin();
+			i_result != results.end() && converged; ++i_result)
+			converged = IsConverged(*i_result, n + 1);
+		if (converged)
+		{
+			cout << "Converged after " << n + 1 << " sweep runs" << endl;
+			break;
+		}
+	}
+
+	for (int i = ExpParams.MinDoubles; i <= maxDoubles; i++)
+	{
+		const RESULTS& result = results[i - ExpParams.MinDoubles];
+		cout << "Simulations = " << (1 << i) << endl
+			<< "Runs = " << result.Time.GetCount() << endl
+			<< "Undiscounted return = " << result.UndiscountedReturn.GetMean()
+			<< " +- " << result.UndiscountedReturn.GetStdErr() << endl
+			<< "Discounted return = " << result.DiscountedReturn.GetMean()
+			<< " +- " << result.DiscountedReturn.GetStdErr() << endl
+			<< "Time = " << result.Time.GetMean() << endl;
+		OutputFile << (1 << i) << "\t"
+			<< result.Time.GetCount() << "\t"
+			<< result.UndiscountedReturn.GetMean() << "\t"
+			<< result.UndiscountedReturn.GetStdErr() << "\t"
+			<< result.DiscountedReturn.GetMean() << "\t"
+			<< result.DiscountedReturn.GetStdErr() << "\t"
+			<< result.NodeCount.GetMean() << "\t"
+			<< result.NodeCount.GetStdErr() << "\t"
+			<< result.Time.GetMean() << endl;
+		NodeCountFile << nodeCountRows[i - ExpParams.MinDoubles].str();
 	}
 }
 
@@ -22,6 +22,10 @@ struct RESULTS
 	STATISTIC DiscountedReturn;
 	STATISTIC UndiscountedReturn;
 	STATISTIC NodeCount;
+
+	// Paired differences to the baseline algorithm
+	STATISTIC UndiscountedDifference;
+	STATISTIC DiscountedDifference;
 };
 
 inline void RESULTS::Clear()
@@ -30,6 +34,8 @@ inline void RESULTS::Clear()
 	Reward.Clear();
 	DiscountedReturn.Clear();
 	UndiscountedReturn.Clear();
+	UndiscountedDifference.Clear();
+	DiscountedDifference.Clear();
 }
 
 //----------------------------------------------------------------------------
@@ -52,6 +58,23 @@ public:
 		double Accuracy;
 		int UndiscountedHorizon;
 		bool AutoExploration;
+		bool BudgetSweep;
+
+		// Drive the real environment from a stream keyed by run and step.
+		// With a baseline, every run also plays the baseline algorithm and
+		// the paired differences are reported
+		bool CommonRandomNumbers;
+		unsigned int Seed;
+		string BaselineAlgorithm;
+
+		// Stop a cell early once the 95% confidence interval of the
+		// undiscounted return, or of its paired difference to the baseline,
+		// is narrower than the target, checked after every batch of runs
+		// from MinRuns on. Zero always runs NumRuns, a BatchSize below one
+		// checks after every run
+		double TargetHalfWidth;
+		int MinRuns;
+		int BatchSize;
 		string AlgorithmName;
 	};
 
@@ -63,15 +86,29 @@ public:
 	void Run();
 	void MultiRun();
 	void DiscountedReturn();
+	void DiscountedReturnSweep();
 	void AverageReward();
 
 private:
 
+	MCTS* CreatePlanner(const std::string& algorithmName);
+	bool IsConverged(const RESULTS& results, int numRuns) const;
+	void RunEpisode(const std::string& algorithmName, RESULTS& results,
+		double& undiscountedReturn, double& discountedReturn);
+	void SweepRun(std::vector<RESULTS>& results);
+	void WriteNodeCount(std::ostream& ostr, int numSimulations,
+		const RESULTS& results) const;
+	void FinishRandom(STATE& state, HISTORY history,
+		const SIMULATOR::STATUS& status, int t, RESULTS& results,
+		double& undiscountedReturn, double& discountedReturn, double& discount);
+
 	const SIMULATOR& Real;
 	const SIMULATOR& Simulator;
 	EXPERIMENT::PARAMS& ExpParams;
 	MCTS::PARAMS& SearchParams;
 	RESULTS Results;
+	RESULTS BaselineResults;
+	int RunIndex;
 
 	std::ofstream OutputFile;
 	std::ofstream NodeCountFile;
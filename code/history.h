@@ -1,14 +1,21 @@
 #ifndef HISTORY_H
 #define HISTORY_H
 
+#include <algorithm>
 #include <vector>
 #include <ostream>
 #include <assert.h>
+#include <stdint.h>
 
 class HISTORY
 {
 public:
 
+	HISTORY()
+		: Hash(0)
+	{
+	}
+
 	struct ENTRY
 	{
 		ENTRY() { }
@@ -17,13 +24,24 @@ public:
 			: Action(action), Observation(obs)
 		{ }
 
+		bool operator==(const ENTRY& entry) const
+		{
+			return Action == entry.Action && Observation == entry.Observation;
+		}
+
+		bool operator<(const ENTRY& entry) const
+		{
+			return Action < entry.Action
+				|| (Action == entry.Action && Observation < entry.Observation);
+		}
+
 		int Action;
 		int Observation;
 	};
 
 	bool operator==(const HISTORY& history) const
 	{
-		if (history.History.size() != History.size())
+		if (history.History.size() != History.size() || history.Hash != Hash)
 			return false;
 		for (int i = 0; i < History.size(); ++i)
 			if (history.History[i].Action != History[i].Action
@@ -35,44 +53,78 @@ public:
 	void Add(int action, int obs = -1)
 	{
 		History.push_back(ENTRY(action, obs));
+		Tally(action, obs, +1);
+		Hash += Key(action, obs);
 	}
 
 	void Pop()
 	{
+		Tally(History.back().Action, History.back().Observation, -1);
+		Hash -= Key(History.back().Action, History.back().Observation);
 		History.pop_back();
 	}
 
 	void Truncate(int t)
 	{
+		assert(t >= 0 && t <= History.size());
+		for (int i = t; i < History.size(); ++i)
+		{
+			Tally(History[i].Action, History[i].Observation, -1);
+			Hash -= Key(History[i].Action, History[i].Observation);
+		}
 		History.resize(t);
 	}
 
 	void Clear()
 	{
 		History.clear();
+		Counts.clear();
+		Hash = 0;
 	}
 
-	int Size() const
+	// Replaces the observation of the last entry
+	void SetObservation(int obs)
 	{
-		return History.size();
+		ENTRY& entry = History.back();
+		Tally(entry.Action, entry.Observation, -1);
+		Hash -= Key(entry.Action, entry.Observation);
+		entry.Observation = obs;
+		Tally(entry.Action, obs, +1);
+		Hash += Key(entry.Action, obs);
 	}
 
-	ENTRY& operator[](int t)
+	// Zobrist style hash, the sum of a pseudo-random key for every entry.
+	// It does not depend on the order of the entries, so histories holding
+	// the same steps in a different order hash alike
+	uint64_t GetHash() const { return Hash; }
+
+	// Entries from t on in sorted order, equal for histories that hold the
+	// same steps from t on in any order
+	void GetSteps(int t, std::vector<ENTRY>& steps) const
 	{
-		assert(t >= 0 && t < History.size());
-		return History[t];
+		assert(t >= 0 && t <= History.size());
+		steps.assign(History.begin() + t, History.end());
+		std::sort(steps.begin(), steps.end());
 	}
 
-	const ENTRY& operator[](int t) const
+	// Number of entries where action was followed by obs, kept up to date
+	// as entries are added and removed
+	int GetCount(int action, int obs) const
 	{
-		assert(t >= 0 && t < History.size());
-		return History[t];
+		if (action >= Counts.size() || obs >= Counts[action].size())
+			return 0;
+		return Counts[action][obs];
 	}
 
-	ENTRY& Back()
+	int Size() const
 	{
-		assert(History.size() > 0);
-		return History.back();
+		return History.size();
+	}
+
+	const ENTRY& operator[](int t) const
+	{
+		assert(t >= 0 && t < History.size());
+		return History[t];
 	}
 
 	const ENTRY& Back() const
@@ -94,7 +146,31 @@ public:
 
 private:
 
+	static uint64_t Key(int action, int obs)
+	{
+		// SplitMix64 finaliser over the packed entry
+		uint64_t key = ((uint64_t) (uint32_t) action << 32 | (uint32_t) obs)
+			+ 0x9e3779b97f4a7c15ULL;
+		key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+		return key ^ (key >> 31);
+	}
+
+	void Tally(int action, int obs, int delta)
+	{
+		if (obs < 0)
+			return;
+		if (action >= Counts.size())
+			Counts.resize(action + 1);
+		std::vector<int>& counts = Counts[action];
+		if (obs >= counts.size())
+			counts.resize(obs + 1, 0);
+		counts[obs] += delta;
+	}
+
 	std::vector<ENTRY> History;
+	std::vector<std::vector<int> > Counts;
+	uint64_t Hash;
 };
 
 #endif // HISTORY
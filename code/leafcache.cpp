@@ -0,0 +1,55 @@
+#include "leafcache.h"
+
+LEAF_CACHE::LEAF_CACHE()
+	: Mask(0)
+{
+}
+
+void LEAF_CACHE::Resize(int capacity)
+{
+	int size = 0;
+	if (capacity > 0)
+		for (size = 1; size < capacity; size <<= 1);
+	Entries.resize(size);
+	Mask = size ? size - 1 : 0;
+	Clear();
+}
+
+void LEAF_CACHE::Clear()
+{
+	for (std::vector<ENTRY>::iterator i_entry = Entries.begin();
+		i_entry != Entries.end(); ++i_entry)
+	{
+		i_entry->Key = 0;
+		i_entry->Count = 0;
+		i_entry->Mean = 0;
+	}
+}
+
+bool LEAF_CACHE::Find(uint64_t key, double& mean, int& count) const
+{
+	int slot = Slot(key);
+	std::lock_guard<std::mutex> guard(Lock(slot));
+	const ENTRY& entry = Entries[slot];
+	if (entry.Count == 0 || entry.Key != key)
+		return false;
+	mean = entry.Mean;
+	count = entry.Count;
+	return true;
+}
+
+double LEAF_CACHE::Add(uint64_t key, double value)
+{
+	int slot = Slot(key);
+	std::lock_guard<std::mutex> guard(Lock(slot));
+	ENTRY& entry = Entries[slot];
+	if (entry.Count == 0 || entry.Key != key)
+	{
+		entry.Key = key;
+		entry.Count = 0;
+		entry.Mean = 0;
+	}
+	entry.Count++;
+	entry.Mean += (value - entry.Mean) / entry.Count;
+	return entry.Mean;
+}
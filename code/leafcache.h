@@ -0,0 +1,50 @@
+#ifndef LEAF_CACHE_H
+#define LEAF_CACHE_H
+
+#include <vector>
+#include <mutex>
+#include <stdint.h>
+
+//----------------------------------------------------------------------------
+// Bounded table of mean leaf values, keyed by a hash of the leaf state and
+// the remaining search depth. Each key maps to one slot, and a new key
+// simply replaces the old one. Slots are guarded by striped locks, so one
+// cache can be shared by several searching threads.
+
+class LEAF_CACHE
+{
+public:
+
+	LEAF_CACHE();
+
+	// Capacity is rounded up to a power of two, zero disables the cache
+	void Resize(int capacity);
+	void Clear();
+	bool Enabled() const { return !Entries.empty(); }
+
+	// Mean and number of values stored for key, false if there are none
+	bool Find(uint64_t key, double& mean, int& count) const;
+
+	// Adds a value to the mean for key and returns the new mean
+	double Add(uint64_t key, double value);
+
+private:
+
+	struct ENTRY
+	{
+		uint64_t Key;
+		int Count;
+		double Mean;
+	};
+
+	int Slot(uint64_t key) const { return (int) (key & Mask); }
+	std::mutex& Lock(int slot) const { return Locks[slot % NumLocks]; }
+
+	static const int NumLocks = 64;
+
+	std::vector<ENTRY> Entries;
+	uint64_t Mask;
+	mutable std::mutex Locks[NumLocks];
+};
+
+#endif // LEAF_CACHE_H
@@ -25,7 +25,7 @@ public:
 		return interventionalBandit->play();
 	}
 
-	int intervene(const std::vector<int>& legalArms)
+	int intervene(const ACTION_SET& legalArms)
 	{
 		return interventionalBandit->sampleFrom(legalArms);
 	}
@@ -138,24 +138,21 @@ public:
 	}
 
 	int sampleCounterfactualFrom(
-		const std::vector<int>& heuristicArms,
-		const std::vector<int>& legalArms)
+		const ACTION_SET& heuristicArms,
+		const ACTION_SET& legalArms)
 	{
-		static vector<double> intuitiveValues;
 		intuitiveValues.clear();
-		intuitiveArms.clear();
-		intuitiveArms = heuristicArms;
 		noHeuristic = heuristicArms.size() == legalArms.size();
 		if(warmupPhase > 0 || noHeuristic)
 		{
 			playIndex = ThompsonSampling::sampleFrom(heuristicArms);
 			return playIndex;
 		}
-		for(int intent : intuitiveArms)
+		for(int intent : heuristicArms)
 		{
 			intuitiveValues.push_back(counterfactualArms[intent]->mean());
 		}
-		playIndex = intuitiveArms[argmax(intuitiveValues)];
+		playIndex = heuristicArms[argmax(intuitiveValues)];
 		const int oldCount = newBanditCounts[playIndex];
 		if(oldCount == 0)
 		{
@@ -188,7 +185,7 @@ private:
 	int newBanditCount;
 	int warmupPhase;
 	vector<CounterfactualArm*> counterfactualArms;
-	vector<int> intuitiveArms;
+	vector<double> intuitiveValues;
 };
 
 #endif // MABUC
\ No newline at end of file
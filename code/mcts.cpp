@@ -1,8 +1,12 @@
 #include "mcts.h"
 #include "testsimulator.h"
+#include "boost/timer.hpp"
 #include <math.h>
 
 #include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
 
 using namespace std;
 using namespace UTILS;
@@ -17,12 +21,25 @@ MCTS::PARAMS::PARAMS()
 	UseTransforms(true),
 	NumTransforms(0),
 	MaxAttempts(0),
+	NumTransformThreads(1),
 	ExpandCount(1),
 	EnsembleSize(4),
     BanditArmCapacity(10),
     BanditConvergenceEpsilon(0.01),
 	ExplorationConstant(1),
 	UseRave(false),
+	UseParticleFilter(false),
+	CompressBeliefs(false),
+	UseResampling(false),
+	SummariseBeliefs(false),
+	UseTranspositions(false),
+	LeafCacheSize(0),
+	LeafCacheSamples(8),
+	TreeMemoryBudget(0),
+	UseHugePages(true),
+	BindToLocalNode(false),
+	Ponder(false),
+	RecordCheckpoints(false),
 	RaveDiscount(1.0),
 	RaveConstant(0.01),
 	DisableTree(false),
@@ -40,36 +57,118 @@ MCTS::MCTS(const SIMULATOR& simulator, const PARAMS& params)
 	: Simulator(simulator),
 	Params(params),
 	TreeDepth(0),
+	TreeFull(false),
+	PonderStop(false),
+	NumPondered(0),
 	nodeCount(0)
 {
+	// Action sets have a fixed capacity and are filled without bounds checks
+	if (Simulator.GetNumActions() > ACTION_SET::MaxActions)
+		throw std::invalid_argument("MCTS: simulator has more actions than ACTION_SET::MaxActions");
 	VNODE::NumChildren = Simulator.GetNumActions();
 	QNODE::NumChildren = Simulator.GetNumObservations();
+	VNODE::UseAMAF = Params.UseRave;
+	VNODE::UseAlpha = Simulator.HasAlpha();
+	VNODE::UseObservationCounts = Params.kObservations > 0 && Params.alphaObservations > 0;
+	CHUNK_MEMORY::UseHugePages = Params.UseHugePages;
+	CHUNK_MEMORY::BindToLocalNode = Params.BindToLocalNode;
+	ActionScores.resize(Simulator.GetNumActions());
+	if (Simulator.HasStateHash())
+		LeafCache.Resize(Params.LeafCacheSize);
+
+	// Histories are keyed without their order, which only the domain can
+	// vouch for. Pruning frees whole subtrees, which is unsafe once nodes
+	// are shared
+	if (!Simulator.HasCommutativeHistory() || Params.TreeMemoryBudget > 0)
+		Params.UseTranspositions = false;
 
 	Root = ExpandNode(Simulator.CreateStartState());
 
+	// Identical particles are merged in root beliefs only, tree nodes keep
+	// their particles as sampled
+	Root->Beliefs().SetCompressed(Params.CompressBeliefs && Simulator.HasStateHash());
+	// Every start state begins its own scenario, which its successors inherit
 	for (int i = 0; i < Params.NumStartStates; i++)
-		Root->Beliefs().AddSample(Simulator.CreateStartState());
+	{
+		STATE* state = Simulator.CreateStartState();
+		state->ScenarioId = i;
+		Root->Beliefs().AddSample(state, Simulator);
+	}
+	SummariseBeliefs(Root->Beliefs());
 }
 
 MCTS::~MCTS()
 {
-	VNODE::Free(Root, Simulator);
-	VNODE::FreeAll();
+	StopPondering();
+	VNODE::FreeTree();
+	VNODE::FreeAll(Simulator);
 }
 
 bool MCTS::Update(int action, int observation, double reward)
 {
+	StopPondering();
 	History.Add(action, observation);
 	BELIEF_STATE beliefs;
+	if (!UpdateBeliefs(action, observation, beliefs))
+		return false;
 
-	// Find matching vnode from the rest of the tree
-	QNODE& qnode = Root->Child(action);
-	VNODE* vnode = qnode.Child(observation);
-	if (vnode)
+	if (Params.Verbose >= 1)
+		Simulator.DisplayBeliefs(beliefs, cout);
+	SummariseBeliefs(beliefs);
+
+	// Find a state to initialise prior (only requires fully observed state)
+	// The matched node's samples are copied into beliefs, so this outlives the old tree
+	const STATE* state = beliefs.GetSample(0);
+	VNODE* vnode = Root->Child(action).Child(observation);
+	// Release old tree and create new root. When pondering, the matched
+	// subtree is kept as the new root, only its particles are replaced.
+	// Shared transposition nodes could belong to other subtrees
+	VNODE* newRoot;
+	if (Params.Ponder && !Params.UseTranspositions && vnode)
+	{
+		VNODE::FreeExcept(Root, vnode, Simulator);
+		vnode->Beliefs().Free(Simulator);
+		newRoot = vnode;
+	}
+	else
+	{
+		Transpositions.clear();
+		VNODE::FreeTree();
+		newRoot = ExpandNode(state);
+	}
+	newRoot->Beliefs() = beliefs;
+	Root = newRoot;
+	TreeFull = false;
+	return true;
+}
+
+// Root beliefs after the next step, which must already be in History. The
+// tree is left unchanged, so this can be called for several steps in turn
+// With maxSamples, the matched node contributes only its first maxSamples
+// particles, which are the ones it held after a smaller search
+bool MCTS::UpdateBeliefs(int action, int observation, BELIEF_STATE& beliefs,
+	int maxSamples)
+{
+	beliefs.SetCompressed(Params.CompressBeliefs && Simulator.HasStateHash());
+
+	// Weighted update of the root particles when the simulator supports it
+	bool filtered = Params.UseParticleFilter && Simulator.HasObservationLikelihood()
+		&& FilterParticles(action, observation, beliefs);
+
+	// Otherwise find matching vnode from the rest of the tree
+	VNODE* vnode = Root->Child(action).Child(observation);
+	if (maxSamples == 0)
+		vnode = 0;
+	if (filtered)
+	{
+		if (Params.Verbose >= 1)
+			cout << "Filtered " << beliefs.GetNumSamples() << " states" << endl;
+	}
+	else if (vnode)
 	{
 		if (Params.Verbose >= 1)
 			cout << "Matched " << vnode->Beliefs().GetNumSamples() << " states" << endl;
-		beliefs.Copy(vnode->Beliefs(), Simulator);
+		beliefs.Copy(vnode->Beliefs(), Simulator, maxSamples);
 	}
 	else
 	{
@@ -78,28 +177,109 @@ bool MCTS::Update(int action, int observation, double reward)
 	}
 
 	// Generate transformed states to avoid particle deprivation
-	if (Params.UseTransforms)
+	if (Params.UseTransforms && !filtered)
 		AddTransforms(Root, beliefs);
 
+	// Restore the particle count, the particle filter already resamples
+	if (Params.UseResampling && !filtered)
+		Resample(beliefs);
+
 	// If we still have no particles, fail
-	if (beliefs.Empty() && (!vnode || vnode->Beliefs().Empty()))
-		return false;
+	return !beliefs.Empty() || (vnode && !vnode->Beliefs().Empty());
+}
+
+bool MCTS::NextBeliefs(int action, int observation, BELIEF_STATE& beliefs,
+	int checkpoint)
+{
+	StopPondering();
+	int maxSamples = -1;
+	if (checkpoint >= 0 && checkpoint < (int) CheckpointActions.size()
+		&& CheckpointActions[checkpoint] == action)
+		maxSamples = CheckpointParticles[checkpoint][observation];
+	History.Add(action, observation);
+	bool success = UpdateBeliefs(action, observation, beliefs, maxSamples);
+	History.Truncate(History.Size() - 1);
+	return success;
+}
+
+void MCTS::SetRoot(BELIEF_STATE& beliefs, const HISTORY& history)
+{
+	StopPondering();
+	History = history;
+	Transpositions.clear();
+	VNODE::FreeTree();
+	SummariseBeliefs(beliefs);
+	Root = ExpandNode(beliefs.GetSample(0));
+	Root->Beliefs() = beliefs;
+	TreeFull = false;
+	beliefs = BELIEF_STATE();
+}
+
+// Summarises the beliefs of the next root, before it is expanded so that its
+// priors already see the summary. History must already end at the new root
+void MCTS::SummariseBeliefs(const BELIEF_STATE& beliefs)
+{
+	if (!Params.SummariseBeliefs)
+		return;
+	Simulator.SummariseBeliefs(beliefs, BeliefSummary);
+	Status.BeliefSummary = BeliefSummary.empty() ? 0 : &BeliefSummary;
+	Status.BeliefSummaryDepth = History.Size();
+}
+
+void MCTS::StartPondering(int action)
+{
+	if (!Params.Ponder || Params.DisableTree)
+		return;
+	StopPondering();
+	PonderStop = false;
+	unsigned int seed = rand();
+	PonderThread = std::thread(&MCTS::RunPonder, this, action, seed);
+}
 
+void MCTS::StopPondering()
+{
+	if (!PonderThread.joinable())
+		return;
+	PonderStop = true;
+	PonderThread.join();
 	if (Params.Verbose >= 1)
-		Simulator.DisplayBeliefs(beliefs, cout);
+		cout << "Pondered " << NumPondered << " simulations" << endl;
+}
 
-	// Find a state to initialise prior (only requires fully observed state)
-	const STATE* state = 0;
-	if (vnode && !vnode->Beliefs().Empty())
-		state = vnode->Beliefs().GetSample(0);
-	else
-		state = beliefs.GetSample(0);
-	// Delete old tree and create new root
-	VNODE::Free(Root, Simulator);
-	VNODE* newRoot = ExpandNode(state);
-	newRoot->Beliefs() = beliefs;
-	Root = newRoot;
-	return true;
+// Only the pondering thread touches the tree and the simulator until
+// StopPondering joins it
+void MCTS::RunPonder(int action, unsigned int seed)
+{
+	std::mt19937 generator(seed);
+	ThreadGenerator = &generator;
+	Ponder(action);
+	ThreadGenerator = 0;
+}
+
+// Runs simulations that start with the committed action, so that the
+// observations most likely to follow it collect particles and subtrees.
+// Stops after one search budget, and prunes like UCTSearch, to bound the
+// tree size
+void MCTS::Ponder(int action)
+{
+	int historyDepth = History.Size();
+	const int maxNodes = MaxTreeNodes();
+
+	for (NumPondered = 0; NumPondered < Params.NumSimulations && !PonderStop; NumPondered++)
+	{
+		STATE* state = Root->Beliefs().CreateSample(Simulator);
+		Simulator.Validate(*state);
+		Status.Phase = SIMULATOR::STATUS::TREE;
+		TreeDepth = 0;
+		PeakTreeDepth = 0;
+		double totalReward = SimulateQ(*state, Root, action);
+		Root->Value.Add(totalReward);
+		Simulator.FreeState(state);
+		History.Truncate(historyDepth);
+
+		if (maxNodes && !TreeFull && VNODE::GetNumAllocated() > maxNodes)
+			PruneTree(maxNodes);
+	}
 }
 
 int MCTS::SelectAction()
@@ -115,7 +295,7 @@ void MCTS::RolloutSearch()
 {
 	std::vector<double> totals(Simulator.GetNumActions(), 0.0);
 	int historyDepth = History.Size();
-	std::vector<int> legal;
+	ACTION_SET legal;
 	assert(BeliefState().GetNumSamples() > 0);
 	Simulator.GenerateLegal(*BeliefState().GetSample(0), GetHistory(), legal, GetStatus());
 	random_shuffle(legal.begin(), legal.end());
@@ -130,17 +310,18 @@ void MCTS::RolloutSearch()
 		double immediateReward, delayedReward, totalReward;
 		bool terminal = Simulator.Step(*state, action, observation, immediateReward);
 
-		VNODE*& vnode = Root->Child(action).Child(observation);
-		if (!vnode && !terminal)
+		QNODE qnode = Root->Child(action);
+		if (!qnode.Child(observation) && !terminal)
 		{
-			vnode = ExpandNode(state);
+			VNODE* vnode = ExpandNode(state);
 			AddSample(vnode, *state);
+			qnode.SetChild(observation, vnode);
 		}
 		History.Add(action, observation);
 
 		delayedReward = Rollout(*state);
 		totalReward = immediateReward + Simulator.GetDiscount() * delayedReward;
-		Root->Child(action).Value.Add(totalReward);
+		Root->ChildValues.Add(action, totalReward);
 
 		Simulator.FreeState(state);
 		History.Truncate(historyDepth);
@@ -150,7 +331,14 @@ void MCTS::RolloutSearch()
 void MCTS::UCTSearch()
 {
 	ClearStatistics();
+	CheckpointActions.clear();
+	CheckpointTimes.clear();
+	CheckpointNodeCounts.clear();
+	CheckpointParticles.clear();
+	boost::timer timer;
+	const int startNodeCount = GetNodeCount();
 	int historyDepth = History.Size();
+	const int maxNodes = MaxTreeNodes();
 
 	for (int n = 0; n < Params.NumSimulations; n++)
 	{
@@ -174,13 +362,135 @@ void MCTS::UCTSearch()
 		if (Params.Verbose >= 3)
 			DisplayValue(4, cout);
 
+		// Greedy action after each power of two simulations
+		if (Params.RecordCheckpoints && ((n + 1) & n) == 0)
+			RecordCheckpoint(*state, timer.elapsed(), GetNodeCount() - startNodeCount);
+
 		Simulator.FreeState(state);
 		History.Truncate(historyDepth);
+
+		if (maxNodes && !TreeFull && VNODE::GetNumAllocated() > maxNodes)
+			PruneTree(maxNodes);
 	}
 
+	StatTreeNodes.Add(VNODE::GetNumAllocated());
 	DisplayStatistics(cout);
 }
 
+// Node for the current history, shared with every other path below the root
+// that holds the same steps. The history ends TreeDepth + 1 steps below the
+// root, and hash hits are confirmed against those steps
+VNODE* MCTS::ExpandTransposition(const STATE& state)
+{
+	std::vector<HISTORY::ENTRY> steps;
+	History.GetSteps(History.Size() - TreeDepth - 1, steps);
+	typedef std::unordered_multimap<uint64_t, TRANSPOSITION>::const_iterator ITERATOR;
+	std::pair<ITERATOR, ITERATOR> range = Transpositions.equal_range(History.GetHash());
+	for (ITERATOR i_entry = range.first; i_entry != range.second; ++i_entry)
+		if (i_entry->second.Steps == steps)
+			return i_entry->second.Node;
+
+	TRANSPOSITION transposition;
+	transposition.Steps.swap(steps);
+	transposition.Node = ExpandNode(&state);
+	Transpositions.insert(std::make_pair(History.GetHash(), transposition));
+	return transposition.Node;
+}
+
+// Records the greedy action, the search time and node count so far, and how
+// many particles each observation child of that action holds. Tree nodes only
+// ever append particles, so these counts mark the beliefs a search of this
+// size had
+void MCTS::RecordCheckpoint(STATE& state, double time, int nodeCount)
+{
+	int action = GreedyUCB(Root, false, state);
+	CheckpointActions.push_back(action);
+	CheckpointTimes.push_back(time);
+	CheckpointNodeCounts.push_back(nodeCount);
+	CheckpointParticles.push_back(std::vector<int>(Simulator.GetNumObservations(), 0));
+	std::vector<int>& particles = CheckpointParticles.back();
+	for (int observation = 0; observation < Simulator.GetNumObservations(); observation++)
+	{
+		VNODE* vnode = Root->Child(action).Child(observation);
+		if (vnode)
+			particles[observation] = vnode->Beliefs().GetNumSamples();
+	}
+}
+
+// Number of tree nodes that fit in TreeMemoryBudget, or 0 without a budget
+int MCTS::MaxTreeNodes() const
+{
+	if (Params.TreeMemoryBudget <= 0)
+		return 0;
+	return (int) ((size_t) Params.TreeMemoryBudget * 1024 * 1024 / VNODE::GetNodeBytes());
+}
+
+// Frees the least visited subtrees below the root until the tree is back
+// under three quarters of the node budget, so that pruning is infrequent.
+// Freed nodes return to the node pool and are reused by later expansions.
+// The root's children hold the particles for the next update, so they are
+// never freed. If they alone keep the tree above three quarters of the
+// budget, expansion stops until the next root
+void MCTS::PruneTree(int maxNodes)
+{
+	struct EDGE
+	{
+		VNODE* Parent;
+		int Action, Observation;
+		VNODE* Child;
+	};
+
+	std::vector<EDGE> edges;
+	std::vector<VNODE*> open(1, Root);
+	while (!open.empty())
+	{
+		VNODE* vnode = open.back();
+		open.pop_back();
+		if (vnode->IsLeaf())
+			continue;
+		for (int action = 0; action < VNODE::NumChildren; action++)
+		{
+			QNODE qnode = vnode->Child(action);
+			for (int observation = 0; observation < QNODE::NumChildren; observation++)
+			{
+				VNODE* child = qnode.Child(observation);
+				if (child)
+				{
+					EDGE edge = { vnode, action, observation, child };
+					if (vnode != Root)
+						edges.push_back(edge);
+					open.push_back(child);
+				}
+			}
+		}
+	}
+
+	std::sort(edges.begin(), edges.end(), [](const EDGE& edge1, const EDGE& edge2)
+	{
+		return edge1.Child->Value.GetCount() < edge2.Child->Value.GetCount();
+	});
+
+	const int target = maxNodes / 4 * 3;
+	int numPruned = 0;
+	for (std::vector<EDGE>::iterator i_edge = edges.begin();
+		i_edge != edges.end() && VNODE::GetNumAllocated() > target; ++i_edge)
+	{
+		// Skip edges inside subtrees that have already been freed
+		if (!i_edge->Parent->IsAllocated() || !i_edge->Child->IsAllocated())
+			continue;
+		i_edge->Parent->Child(i_edge->Action).SetChild(i_edge->Observation, 0);
+		VNODE::Free(i_edge->Child, Simulator);
+		numPruned++;
+	}
+	TreeFull = VNODE::GetNumAllocated() > target;
+
+	if (Params.Verbose >= 1)
+	{
+		cout << "Pruned " << numPruned << " subtrees, "
+			<< VNODE::GetNumAllocated() << " nodes remain" << endl;
+	}
+}
+
 double MCTS::SimulateV(STATE& state, VNODE* vnode)
 {
 	int action = SampleAction(vnode, state, true);
@@ -192,22 +502,22 @@ double MCTS::SimulateV(STATE& state, VNODE* vnode)
 	if (TreeDepth == 1)
 		AddSample(vnode, state);
 
-	QNODE& qnode = vnode->Child(action);
-	double totalReward = SimulateQ(state, qnode, action);
+	double totalReward = SimulateQ(state, vnode, action);
 	vnode->Value.Add(totalReward);
 	AddRave(vnode, totalReward);
 	return totalReward;
 }
 
-double MCTS::SimulateQ(STATE& state, QNODE& qnode, int action)
+double MCTS::SimulateQ(STATE& state, VNODE* parent, int action)
 {
+	QNODE qnode = parent->Child(action);
 	//cout << "--> MCTS::SimulateQ" << endl;
 	int observation;
 	double immediateReward, delayedReward = 0;
 
 	const bool progressiveWideningEnabled = Params.kObservations > 0 && Params.alphaObservations > 0;
 	bool progressiveWideningCondition = true;
-	const int totalVisitCount = qnode.Value.GetCount();
+	const int totalVisitCount = parent->ChildValues.GetCount(action);
 	if(progressiveWideningEnabled)
 	{
 		//cout << "--> MCTS::SimulateQ: progressiveWideningEnabled" << endl;
@@ -240,23 +550,20 @@ double MCTS::SimulateQ(STATE& state, QNODE& qnode, int action)
 				//cout << "<-- MCTS::SimulateQ: threshold: " << threshold << endl;
 			}
 			//cout << "<-- MCTS::SimulateQ: observation: " << observation << endl;
-		} while(threshold < randomNumber && observation < qnode.NumChildren);
+		} while(threshold < randomNumber && observation < QNODE::NumChildren - 1);
 		if(threshold < randomNumber)
 		{
 			observation = lastNonNullObservation;
 		}
 		//cout << "<-- MCTS::SimulateQ: sample observation" << endl;
 	}
-	else
-	{
-		//cout << "--> MCTS::SimulateQ: increment children count" << endl;
-		qnode.IncrementChildrenCount(observation);
-		//cout << "<-- MCTS::SimulateQ: increment children count" << endl;
-	}
 	if (Simulator.HasAlpha())
 			Simulator.UpdateAlpha(qnode, state);
 	bool terminal = Simulator.Step(state, action, observation, immediateReward);
 	assert(observation >= 0 && observation < Simulator.GetNumObservations());
+	// The new observation is only known after stepping the simulator
+	if (!progressiveWideningCondition)
+		qnode.IncrementChildrenCount(observation);
 	History.Add(action, observation);
 
 	if (Params.Verbose >= 3)
@@ -267,9 +574,16 @@ double MCTS::SimulateQ(STATE& state, QNODE& qnode, int action)
 		Simulator.DisplayState(state, cout);
 	}
 
-	VNODE*& vnode = qnode.Child(observation);
-	if (!vnode && !terminal && qnode.Value.GetCount() >= Params.ExpandCount)
-		vnode = ExpandNode(&state);
+	VNODE* vnode = qnode.Child(observation);
+	if (!vnode && !terminal && !TreeFull
+		&& parent->ChildValues.GetCount(action) >= Params.ExpandCount)
+	{
+		if (Params.UseTranspositions)
+			vnode = ExpandTransposition(state);
+		else
+			vnode = ExpandNode(&state);
+		qnode.SetChild(observation, vnode);
+	}
 
 	if (!terminal)
 	{
@@ -277,30 +591,32 @@ double MCTS::SimulateQ(STATE& state, QNODE& qnode, int action)
 		if (vnode)
 			delayedReward = SimulateV(state, vnode);
 		else
-			delayedReward = Rollout(state);
+			delayedReward = LeafValue(state);
 		TreeDepth--;
 	}
 
 	double totalReward = immediateReward + Simulator.GetDiscount() * delayedReward;
-	qnode.Value.Add(totalReward);
+	parent->ChildValues.Add(action, totalReward);
 	//cout << "<-- MCTS::SimulateQ" << endl;
 	return totalReward;
 }
 
 void MCTS::AddRave(VNODE* vnode, double totalReward)
 {
+	if (!Params.UseRave)
+		return;
+
 	double totalDiscount = 1.0;
 	for (int t = TreeDepth; t < History.Size(); ++t)
 	{
-		QNODE& qnode = vnode->Child(History[t].Action);
-		qnode.AMAF.Add(totalReward, totalDiscount);
+		vnode->ChildAMAF.Add(History[t].Action, totalReward, totalDiscount);
 		totalDiscount *= Params.RaveDiscount;
 	}
 }
 
 VNODE* MCTS::ExpandNode(const STATE* state)
 {
-	VNODE* vnode = VNODE::Create();
+	VNODE* vnode = VNODE::Create(Simulator);
 	vnode->Value.Set(0, 0);
 	Simulator.Prior(state, History, vnode, Status);
 	IncrementNodeCountBy(1 + Simulator.GetNumActions());
@@ -316,12 +632,11 @@ VNODE* MCTS::ExpandNode(const STATE* state)
 
 void MCTS::AddSample(VNODE* node, const STATE& state)
 {
-	STATE* sample = Simulator.Copy(state);
-	node->Beliefs().AddSample(sample);
+	node->Beliefs().AddCopy(state, Simulator);
 	if (Params.Verbose >= 2)
 	{
 		cout << "Adding sample:" << endl;
-		Simulator.DisplayState(*sample, cout);
+		Simulator.DisplayState(state, cout);
 	}
 }
 
@@ -340,16 +655,16 @@ int MCTS::SampleAction(VNODE* vnode, STATE& state, bool ucb) const
 
 int MCTS::ThompsonSamplingAction(VNODE* vnode, STATE& state) const
 {
-	static boost::mt19937 generator;
-	static vector<int> bestActions;
-	bestActions.clear();
+	// One engine per thread. Threads with their own generator seed it from
+	// there, others keep the default seed
+	thread_local boost::mt19937 generator(ThreadGenerator ? (*ThreadGenerator)() : 5489u);
+	ACTION_SET bestActions;
 	double bestValue = -Infinity;
 	for (int action = 0; action < Simulator.GetNumActions(); action++)
 	{
-		QNODE& qnode = vnode->Child(action);
-		const double mean = qnode.Value.GetValue();
-		const double sq = qnode.Value.GetSquaredValue();
-		const double n = qnode.Value.GetCount();
+		const double mean = vnode->ChildValues.GetValue(action);
+		const double sq = vnode->ChildValues.GetSquaredValue(action);
+		const double n = vnode->ChildValues.GetCount(action);
 		double sampledMean = 0;
 		if(n > 0)
 		{
@@ -394,53 +709,95 @@ int MCTS::ThompsonSamplingAction(VNODE* vnode, STATE& state) const
 
 int MCTS::GreedyUCB(VNODE* vnode, bool ucb, STATE& state) const
 {
-	static vector<int> besta;
-	besta.clear();
-	double bestq = -Infinity;
-	int N = vnode->Value.GetCount();
-	double logN = log(N + 1);
-	bool hasalpha = Simulator.HasAlpha();
-
-	for (int action = 0; action < Simulator.GetNumActions(); action++)
+	const int numActions = Simulator.GetNumActions();
+	double* scores = &ActionScores[0];
+	const int* counts = vnode->ChildValues.Counts();
+	const double* totals = vnode->ChildValues.Totals();
+
+	// Each pass below runs over the node's contiguous per-action arrays and
+	// replaces branches by arithmetic, so the compiler can vectorise it.
+	// Unvisited actions divide by one, which matches VALUE::GetValue.
+	for (int action = 0; action < numActions; action++)
 	{
-		double q, alphaq;
-		int n, alphan;
-
-		QNODE& qnode = vnode->Child(action);
-		q = qnode.Value.GetValue();
-		n = qnode.Value.GetCount();
+		int n = counts[action];
+		scores[action] = totals[action] / (n + (n == 0));
+	}
 
-		if (Params.UseRave && qnode.AMAF.GetCount() > 0)
+	if (Params.UseRave)
+	{
+		const double raveConstant = Params.RaveConstant;
+		const double* amafCounts = vnode->ChildAMAF.Counts();
+		const double* amafTotals = vnode->ChildAMAF.Totals();
+		for (int action = 0; action < numActions; action++)
 		{
-			double n2 = qnode.AMAF.GetCount();
-			double beta = n2 / (n + n2 + Params.RaveConstant * n * n2);
-			q = (1.0 - beta) * q + beta * qnode.AMAF.GetValue();
+			// Without AMAF samples beta is zero and the value is unchanged
+			double n = counts[action];
+			double n2 = amafCounts[action];
+			double amafq = amafTotals[action] / (n2 + (n2 == 0));
+			double beta = n2 / (n + n2 + raveConstant * n * n2 + (n2 == 0));
+			scores[action] = (1.0 - beta) * scores[action] + beta * amafq;
 		}
+	}
 
-		if (hasalpha && n > 0)
+	if (Simulator.HasAlpha())
+	{
+		for (int action = 0; action < numActions; action++)
 		{
-			Simulator.AlphaValue(qnode, alphaq, alphan);
-			q = (n * q + alphan * alphaq) / (n + alphan);
-			//cout << "N = " << n << ", alphaN = " << alphan << endl;
-			//cout << "Q = " << q << ", alphaQ = " << alphaq << endl;
+			double alphaq;
+			int alphan;
+			int n = counts[action];
+			if (n > 0)
+			{
+				Simulator.AlphaValue(vnode->Child(action), alphaq, alphan);
+				scores[action] = (n * scores[action] + alphan * alphaq) / (n + alphan);
+			}
 		}
+	}
 
-		if (ucb)
-			q += FastUCB(N, n, logN);
-
-		if (q >= bestq)
+	// The exploration bonus is computed in place from this planner's own
+	// constant; a vectorised sqrt is cheaper than a table that misses cache
+	if (ucb)
+	{
+		const double exploration = Params.ExplorationConstant;
+		const double logN = log(vnode->Value.GetCount() + 1);
+		for (int action = 0; action < numActions; action++)
 		{
-			if (q > bestq)
-				besta.clear();
-			bestq = q;
-			besta.push_back(action);
+			int n = counts[action];
+			double unvisited = n == 0;
+			double bonus = exploration * sqrt(logN / (n + unvisited));
+			scores[action] += unvisited * Infinity + (1.0 - unvisited) * bonus;
 		}
 	}
 
+	double bestq = -Infinity;
+	for (int action = 0; action < numActions; action++)
+		bestq = scores[action] > bestq ? scores[action] : bestq;
+
+	ACTION_SET besta;
+	for (int action = 0; action < numActions; action++)
+		if (scores[action] == bestq)
+			besta.push_back(action);
+
 	assert(!besta.empty());
 	return besta[Random(besta.size())];
 }
 
+// Rollout value of a leaf, blended with earlier rollouts from an equal state
+// at the same remaining depth when the leaf cache is enabled. Once a leaf
+// has LeafCacheSamples values its mean is used without rolling out
+double MCTS::LeafValue(STATE& state)
+{
+	if (!LeafCache.Enabled())
+		return Rollout(state);
+
+	uint64_t key = HashCombine(Simulator.Hash(state), Params.MaxDepth - TreeDepth);
+	double mean;
+	int count;
+	if (LeafCache.Find(key, mean, count) && count >= Params.LeafCacheSamples)
+		return mean;
+	return LeafCache.Add(key, Rollout(state));
+}
+
 double MCTS::Rollout(STATE& state)
 {
 	Status.Phase = SIMULATOR::STATUS::ROLLOUT;
@@ -479,8 +836,78 @@ double MCTS::Rollout(STATE& state)
 	return totalReward;
 }
 
+bool MCTS::FilterParticles(int action, int observation, BELIEF_STATE& beliefs)
+{
+	const BELIEF_STATE& prior = Root->Beliefs();
+	std::vector<STATE*> particles;
+	std::vector<double> weights;
+	particles.reserve(prior.GetNumParticles());
+	weights.reserve(prior.GetNumParticles());
+
+	// Propagate every root particle and weight it by the real observation,
+	// merged particles are stepped once for each copy they stand for
+	for (int i = 0; i < prior.GetNumSamples(); i++)
+	{
+		for (int copy = 0; copy < prior.GetMultiplicity(i); copy++)
+		{
+			int stepObs;
+			double stepReward;
+			STATE* state = Simulator.Copy(*prior.GetSample(i));
+			state->ScenarioId = prior.GetSample(i)->ScenarioId;
+			bool terminal = Simulator.Step(*state, action, stepObs, stepReward);
+			double weight = terminal ? 0 :
+				Simulator.ObservationLikelihood(*state, action, stepObs, observation);
+			if (weight > 0)
+			{
+				particles.push_back(state);
+				weights.push_back(weight);
+			}
+			else
+				Simulator.FreeState(state);
+		}
+	}
+
+	if (Params.Verbose >= 1)
+	{
+		cout << "Particle filter kept " << particles.size() << " out of "
+			<< prior.GetNumParticles() << " states" << endl;
+	}
+
+	if (particles.empty())
+		return false;
+
+	beliefs.AddResampled(particles, weights, Params.NumStartStates, Simulator);
+	for (std::vector<STATE*>::iterator i_state = particles.begin();
+		i_state != particles.end(); ++i_state)
+		Simulator.FreeState(*i_state);
+	return true;
+}
+
+void MCTS::Resample(BELIEF_STATE& beliefs)
+{
+	if (beliefs.Empty() || beliefs.GetNumParticles() == Params.NumStartStates)
+		return;
+
+	BELIEF_STATE resampled;
+	resampled.SetCompressed(beliefs.IsCompressed());
+	resampled.AddResampled(beliefs, Params.NumStartStates, Simulator);
+	if (Params.Verbose >= 1)
+	{
+		cout << "Resampled " << beliefs.GetNumParticles() << " states to "
+			<< resampled.GetNumParticles() << endl;
+	}
+	std::swap(beliefs, resampled);
+	resampled.Free(Simulator);
+}
+
 void MCTS::AddTransforms(VNODE* root, BELIEF_STATE& beliefs)
 {
+	if (Params.NumTransformThreads > 1)
+	{
+		AddTransformsParallel(beliefs);
+		return;
+	}
+
 	int attempts = 0, added = 0;
 
 	// Local transformations of state that are consistent with history
@@ -489,7 +916,7 @@ void MCTS::AddTransforms(VNODE* root, BELIEF_STATE& beliefs)
 		STATE* transform = CreateTransform();
 		if (transform)
 		{
-			beliefs.AddSample(transform);
+			beliefs.AddSample(transform, Simulator);
 			added++;
 		}
 		attempts++;
@@ -502,44 +929,95 @@ void MCTS::AddTransforms(VNODE* root, BELIEF_STATE& beliefs)
 	}
 }
 
-STATE* MCTS::CreateTransform() const
+// Candidates are sampled and freed on the calling thread, so that workers only
+// run Step and LocalMove. Each worker owns a contiguous slice of the batch and
+// its own generator, and all workers stop once enough have been accepted
+void MCTS::AddTransformsParallel(BELIEF_STATE& beliefs)
 {
-	int stepObs;
-	double stepReward;
+	static const int CandidatesPerThread = 32;
+	const int numThreads = Params.NumTransformThreads;
+	std::vector<STATE*> candidates;
+	std::vector<char> accepted;
+	std::vector<std::thread> workers;
+	int attempts = 0, added = 0;
+
+	while (added < Params.NumTransforms && attempts < Params.MaxAttempts)
+	{
+		int numCandidates = min(numThreads * CandidatesPerThread,
+			Params.MaxAttempts - attempts);
+		candidates.resize(numCandidates);
+		accepted.assign(numCandidates, 0);
+		for (int i = 0; i < numCandidates; i++)
+			candidates[i] = Root->Beliefs().CreateSample(Simulator);
+
+		const int needed = Params.NumTransforms - added;
+		const int sliceSize = (numCandidates + numThreads - 1) / numThreads;
+		std::atomic<int> numAccepted(0), numAttempted(0);
+		for (int w = 0; w < numThreads; w++)
+		{
+			unsigned int seed = rand();
+			int begin = w * sliceSize;
+			int end = min(begin + sliceSize, numCandidates);
+			workers.push_back(std::thread([&, seed, begin, end]()
+			{
+				std::mt19937 generator(seed);
+				ThreadGenerator = &generator;
+				for (int i = begin; i < end && numAccepted < needed; i++)
+				{
+					numAttempted++;
+					if (ApplyTransform(*candidates[i]))
+					{
+						accepted[i] = 1;
+						numAccepted++;
+					}
+				}
+				ThreadGenerator = 0;
+			}));
+		}
+		for (std::vector<std::thread>::iterator i_worker = workers.begin();
+			i_worker != workers.end(); ++i_worker)
+			i_worker->join();
+		workers.clear();
+
+		// Merge the accepted batch in order and release everything else
+		for (int i = 0; i < numCandidates; i++)
+		{
+			if (accepted[i] && added < Params.NumTransforms)
+			{
+				beliefs.AddSample(candidates[i], Simulator);
+				added++;
+			}
+			else
+				Simulator.FreeState(candidates[i]);
+		}
+		attempts += numAttempted;
+	}
+
+	if (Params.Verbose >= 1)
+	{
+		cout << "Created " << added << " local transformations out of "
+			<< attempts << " attempts on " << numThreads << " threads" << endl;
+	}
+}
 
+STATE* MCTS::CreateTransform() const
+{
 	STATE* state = Root->Beliefs().CreateSample(Simulator);
-	Simulator.Step(*state, History.Back().Action, stepObs, stepReward);
-	if (Simulator.LocalMove(*state, History, stepObs, Status))
+	if (ApplyTransform(*state))
 		return state;
 	Simulator.FreeState(state);
 	return 0;
 }
 
-double MCTS::UCB[UCB_N][UCB_n];
-bool MCTS::InitialisedFastUCB = true;
-
-void MCTS::InitFastUCB(double exploration)
-{
-	cout << "Initialising fast UCB table... ";
-	for (int N = 0; N < UCB_N; ++N)
-		for (int n = 0; n < UCB_n; ++n)
-			if (n == 0)
-				UCB[N][n] = Infinity;
-			else
-				UCB[N][n] = exploration * sqrt(log(N + 1) / n);
-	cout << "done" << endl;
-	InitialisedFastUCB = true;
-}
-
-inline double MCTS::FastUCB(int N, int n, double logN) const
+// Steps a sampled state with the last real action and perturbs it to be
+// consistent with the last real observation
+bool MCTS::ApplyTransform(STATE& state) const
 {
-	if (InitialisedFastUCB && N < UCB_N && n < UCB_n)
-		return UCB[N][n];
+	int stepObs;
+	double stepReward;
 
-	if (n == 0)
-		return Infinity;
-	else
-		return Params.ExplorationConstant * sqrt(logN / n);
+	Simulator.Step(state, History.Back().Action, stepObs, stepReward);
+	return Simulator.LocalMove(state, History, stepObs, Status);
 }
 
 void MCTS::ClearStatistics()
@@ -556,6 +1034,9 @@ void MCTS::DisplayStatistics(ostream& ostr) const
 		StatTreeDepth.Print("Tree depth", ostr);
 		StatRolloutDepth.Print("Rollout depth", ostr);
 		StatTotalReward.Print("Total reward", ostr);
+		StatTreeNodes.Print("Tree nodes", ostr);
+		ostr << "Tree memory = " << VNODE::GetNumAllocated() * VNODE::GetNodeBytes()
+			/ (1024.0 * 1024.0) << " MB" << endl;
 	}
 
 	if (Params.Verbose >= 2)
@@ -602,9 +1083,9 @@ void MCTS::UnitTestGreedy()
 
 	VNODE* vnode = mcts.ExpandNode(testSimulator.CreateStartState());
 	vnode->Value.Set(1, 0);
-	vnode->Child(0).Value.Set(0, 1);
+	vnode->ChildValues.Set(0, 0, 1);
 	for (int action = 1; action < numAct; action++)
-		vnode->Child(action).Value.Set(0, 0);
+		vnode->ChildValues.Set(action, 0, 0);
 	assert(mcts.GreedyUCB(vnode, false) == 0);
 }
 
@@ -621,9 +1102,9 @@ void MCTS::UnitTestUCB()
 	vnode1->Value.Set(1, 0);
 	for (int action = 0; action < numAct; action++)
 		if (action == 3)
-			vnode1->Child(action).Value.Set(99, 0);
+			vnode1->ChildValues.Set(action, 99, 0);
 		else
-			vnode1->Child(action).Value.Set(100 + action, 0);
+			vnode1->ChildValues.Set(action, 100 + action, 0);
 	assert(mcts.GreedyUCB(vnode1, true) == 3);
 
 	// With high counts, action with highest value is selected
@@ -631,9 +1112,9 @@ void MCTS::UnitTestUCB()
 	vnode2->Value.Set(1, 0);
 	for (int action = 0; action < numAct; action++)
 		if (action == 3)
-			vnode2->Child(action).Value.Set(99 + numObs, 1);
+			vnode2->ChildValues.Set(action, 99 + numObs, 1);
 		else
-			vnode2->Child(action).Value.Set(100 + numAct - action, 0);
+			vnode2->ChildValues.Set(action, 100 + numAct - action, 0);
 	assert(mcts.GreedyUCB(vnode2, true) == 3);
 
 	// Action with low value and low count beats actions with high counts
@@ -641,9 +1122,9 @@ void MCTS::UnitTestUCB()
 	vnode3->Value.Set(1, 0);
 	for (int action = 0; action < numAct; action++)
 		if (action == 3)
-			vnode3->Child(action).Value.Set(1, 1);
+			vnode3->ChildValues.Set(action, 1, 1);
 		else
-			vnode3->Child(action).Value.Set(100 + action, 1);
+			vnode3->ChildValues.Set(action, 100 + action, 1);
 	assert(mcts.GreedyUCB(vnode3, true) == 3);
 
 	// Actions with zero count is always selected
@@ -651,9 +1132,9 @@ void MCTS::UnitTestUCB()
 	vnode4->Value.Set(1, 0);
 	for (int action = 0; action < numAct; action++)
 		if (action == 3)
-			vnode4->Child(action).Value.Set(0, 0);
+			vnode4->ChildValues.Set(action, 0, 0);
 		else
-			vnode4->Child(action).Value.Set(1, 1);
+			vnode4->ChildValues.Set(action, 1, 1);
 	assert(mcts.GreedyUCB(vnode4, true) == 3);
 }
 
@@ -4,10 +4,14 @@
 #include "simulator.h"
 #include "node.h"
 #include "statistic.h"
+#include "leafcache.h"
 #include <boost/random.hpp>
 #include <boost/random/gamma_distribution.hpp>
 #include <random>
+#include <atomic>
 #include <chrono>
+#include <thread>
+#include <unordered_map>
 
 class MCTS
 {
@@ -23,6 +27,7 @@ public:
 		bool UseTransforms;
 		int NumTransforms;
 		int MaxAttempts;
+		int NumTransformThreads;
 		int ExpandCount;
 		int EnsembleSize;
         int BanditArmCapacity;
@@ -30,6 +35,18 @@ public:
 		int BanditBetaPrior;
 		double ExplorationConstant;
 		bool UseRave;
+		bool UseParticleFilter;
+		bool CompressBeliefs;
+		bool UseResampling;
+		bool SummariseBeliefs;
+		bool UseTranspositions;
+		int LeafCacheSize;
+		int LeafCacheSamples;
+		int TreeMemoryBudget;
+		bool UseHugePages;
+		bool BindToLocalNode;
+		bool Ponder;
+		bool RecordCheckpoints;
 		double RaveDiscount;
 		double RaveConstant;
 		bool DisableTree;
@@ -49,10 +66,33 @@ public:
 	virtual int SampleAction(VNODE* vnode, STATE& state, bool ucb) const;
 	virtual bool Update(int action, int observation, double reward);
 
+	// Root beliefs after a step, computed from the current tree without
+	// updating it. Fails if no particles are left. With a checkpoint, only
+	// the particles the matched node held at that checkpoint are used
+	bool NextBeliefs(int action, int observation, BELIEF_STATE& beliefs,
+		int checkpoint = -1);
+
+	// Discards the tree and restarts from beliefs, which are taken over
+	void SetRoot(BELIEF_STATE& beliefs, const HISTORY& history);
+	void SetNumSimulations(int numSimulations) { Params.NumSimulations = numSimulations; }
+
+	// Greedy root actions after 1, 2, 4, ... simulations of the last search,
+	// and the search time in seconds and nodes counted up to each of them.
+	// Only recorded with RecordCheckpoints
+	const std::vector<int>& GetCheckpointActions() const { return CheckpointActions; }
+	const std::vector<double>& GetCheckpointTimes() const { return CheckpointTimes; }
+	const std::vector<int>& GetCheckpointNodeCounts() const { return CheckpointNodeCounts; }
+
 	void UCTSearch();
 	void RolloutSearch();
 
+	// Keeps searching below the committed action on a background thread
+	// while the real environment steps, until the next Update
+	void StartPondering(int action);
+	void StopPondering();
+
 	double Rollout(STATE& state);
+	double LeafValue(STATE& state);
 
 	const BELIEF_STATE& BeliefState() const { return Root->Beliefs(); }
 	const HISTORY& GetHistory() const { return History; }
@@ -63,7 +103,6 @@ public:
 	void DisplayPolicy(int depth, std::ostream& ostr) const;
 
 	static void UnitTest();
-	static void InitFastUCB(double exploration);
 
 	int GreedyUCB(VNODE* vnode, bool ucb, STATE& state) const;
 	int ThompsonSamplingAction(VNODE* vnode, STATE& state) const;
@@ -88,29 +127,72 @@ public:
 		return nodeCountStatistics.GetMean();
 	}
 	virtual double SimulateV(STATE& state, VNODE* vnode);
-	virtual double SimulateQ(STATE& state, QNODE& qnode, int action);
+	virtual double SimulateQ(STATE& state, VNODE* parent, int action);
 	void AddRave(VNODE* vnode, double totalReward);
 	virtual VNODE* ExpandNode(const STATE* state);
+	VNODE* ExpandTransposition(const STATE& state);
 	virtual void AddSample(VNODE* node, const STATE& state);
+	bool FilterParticles(int action, int observation, BELIEF_STATE& beliefs);
 	void AddTransforms(VNODE* root, BELIEF_STATE& beliefs);
+	void AddTransformsParallel(BELIEF_STATE& beliefs);
 	STATE* CreateTransform() const;
+	bool ApplyTransform(STATE& state) const;
 	void Resample(BELIEF_STATE& beliefs);
+	void SummariseBeliefs(const BELIEF_STATE& beliefs);
+	void PruneTree(int maxNodes);
+	int MaxTreeNodes() const;
+	bool UpdateBeliefs(int action, int observation, BELIEF_STATE& beliefs,
+		int maxSamples = -1);
+	void RecordCheckpoint(STATE& state, double time, int nodeCount);
+	void RunPonder(int action, unsigned int seed);
 
-	// Fast lookup table for UCB
-	static const int UCB_N = 10000, UCB_n = 100;
-	static double UCB[UCB_N][UCB_n];
-	static bool InitialisedFastUCB;
+	// Simulations below the committed action, run on the pondering thread
+	// until PonderStop is set. Planners that do not search the tree below
+	// Root must override it or disable Params.Ponder
+	virtual void Ponder(int action);
 
-	double FastUCB(int N, int n, double logN) const;
 	const SIMULATOR& Simulator;
+	mutable std::vector<double> ActionScores;
 	int TreeDepth, PeakTreeDepth;
 	PARAMS Params;
+
+	// Set when pruning could not bring the tree back under three quarters of
+	// TreeMemoryBudget, so that the tree stops growing instead of being
+	// pruned every simulation. Cleared with each new root
+	bool TreeFull;
+
 	VNODE* Root;
 	HISTORY History;
 	SIMULATOR::STATUS Status;
+	std::vector<double> BeliefSummary;
+	std::vector<int> CheckpointActions;
+	std::vector<double> CheckpointTimes;
+	std::vector<int> CheckpointNodeCounts;
+
+	// Particles in each observation child of the greedy action, per checkpoint
+	std::vector<std::vector<int> > CheckpointParticles;
+
+	// Nodes by history hash, so that paths holding the same steps in a
+	// different order share one node. Each keeps its sorted steps below the
+	// root, which every hash hit must match. Only valid until the next Update
+	struct TRANSPOSITION
+	{
+		std::vector<HISTORY::ENTRY> Steps;
+		VNODE* Node;
+	};
+	std::unordered_multimap<uint64_t, TRANSPOSITION> Transpositions;
+
+	// Mean rollout values by leaf state and remaining depth, kept across
+	// updates since they do not depend on the tree
+	LEAF_CACHE LeafCache;
+
+	std::thread PonderThread;
+	std::atomic<bool> PonderStop;
+	int NumPondered;
 	STATISTIC StatTreeDepth;
 	STATISTIC StatRolloutDepth;
 	STATISTIC StatTotalReward;
+	STATISTIC StatTreeNodes;
 protected:
 	STATISTIC nodeCountStatistics;
 private:
@@ -0,0 +1,113 @@
+#include "memorypool.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdint.h>
+
+bool CHUNK_MEMORY::UseHugePages = true;
+bool CHUNK_MEMORY::BindToLocalNode = false;
+
+namespace
+{
+	const size_t HugePageSize = 2 * 1024 * 1024;
+
+	// Prefers the NUMA node the calling thread is running on. Uses the raw
+	// system calls so that no NUMA library is needed
+	void BindToNode(void* memory, size_t bytes)
+	{
+#if defined(SYS_getcpu) && defined(SYS_mbind)
+		static const int MPOL_PREFERRED = 1;
+		unsigned int cpu, node;
+		if (syscall(SYS_getcpu, &cpu, &node, 0) != 0 || node >= 64)
+			return;
+		unsigned long mask = 1UL << node;
+		syscall(SYS_mbind, memory, bytes, MPOL_PREFERRED, &mask, 64, 0);
+#else
+		(void) memory;
+		(void) bytes;
+#endif
+	}
+}
+
+void* CHUNK_MEMORY::Allocate(size_t bytes)
+{
+	const size_t pageSize = sysconf(_SC_PAGESIZE);
+	bytes = (bytes + pageSize - 1) / pageSize * pageSize;
+	const bool huge = UseHugePages && bytes >= HugePageSize;
+
+	// Over-allocate huge chunks by one huge page, then trim both ends so that
+	// the chunk starts on a huge page boundary
+	size_t mapped = huge ? bytes + HugePageSize : bytes;
+	void* memory = mmap(0, mapped, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED)
+		throw std::bad_alloc();
+
+	if (huge)
+	{
+		uintptr_t begin = reinterpret_cast<uintptr_t>(memory);
+		uintptr_t aligned = (begin + HugePageSize - 1) / HugePageSize * HugePageSize;
+		if (aligned > begin)
+			munmap(memory, aligned - begin);
+		if (aligned + bytes < begin + mapped)
+			munmap(reinterpret_cast<void*>(aligned + bytes), begin + mapped - aligned - bytes);
+		memory = reinterpret_cast<void*>(aligned);
+#ifdef MADV_HUGEPAGE
+		madvise(memory, bytes, MADV_HUGEPAGE);
+#endif
+	}
+
+	if (BindToLocalNode)
+		BindToNode(memory, bytes);
+	return memory;
+}
+
+void CHUNK_MEMORY::Free(void* memory, size_t bytes)
+{
+	const size_t pageSize = sysconf(_SC_PAGESIZE);
+	munmap(memory, (bytes + pageSize - 1) / pageSize * pageSize);
+}
+
+//-----------------------------------------------------------------------------
+
+namespace
+{
+	std::mutex SlotLock;
+	std::vector<int> FreeSlots;
+	int NumSlots = 0;
+
+	int AcquireSlot()
+	{
+		std::lock_guard<std::mutex> guard(SlotLock);
+		if (!FreeSlots.empty())
+		{
+			int slot = FreeSlots.back();
+			FreeSlots.pop_back();
+			return slot;
+		}
+		if (NumSlots < THREAD_SLOT::MaxSlots)
+			return NumSlots++;
+		return THREAD_SLOT::Overflow;
+	}
+
+	void ReleaseSlot(int slot)
+	{
+		if (slot == THREAD_SLOT::Overflow)
+			return;
+		std::lock_guard<std::mutex> guard(SlotLock);
+		FreeSlots.push_back(slot);
+	}
+
+	struct SLOT_HOLDER
+	{
+		SLOT_HOLDER() : Slot(AcquireSlot()) { }
+		~SLOT_HOLDER() { ReleaseSlot(Slot); }
+		const int Slot;
+	};
+}
+
+int THREAD_SLOT::Get()
+{
+	thread_local SLOT_HOLDER holder;
+	return holder.Slot;
+}
@@ -1,6 +1,10 @@
 #ifndef MEMORY_POOL_H
 #define MEMORY_POOL_H
 
+#include <assert.h>
+#include <stddef.h>
+#include <mutex>
+#include <new>
 #include <vector>
 #include <ostream>
 
@@ -17,13 +21,54 @@ private:
 	bool Allocated;
 };
 
+//-----------------------------------------------------------------------------
+// Page-aligned memory for pool chunks, mapped directly from the kernel. Large
+// chunks are aligned to huge pages and marked for transparent huge pages, and
+// may be bound to the NUMA node of the allocating thread. Both are hints that
+// are silently ignored where unsupported.
+
+class CHUNK_MEMORY
+{
+public:
+
+	static void* Allocate(size_t bytes);
+	static void Free(void* memory, size_t bytes);
+
+	static bool UseHugePages;
+	static bool BindToLocalNode;
+};
+
+//-----------------------------------------------------------------------------
+// Small index for the calling thread, used to find its cache in each pool.
+// Indices are returned when a thread exits and handed to the next new thread,
+// so short-lived workers do not exhaust them. Threads beyond MaxSlots all
+// share the Overflow index.
+
+class THREAD_SLOT
+{
+public:
+
+	static int Get();
+
+	static const int MaxSlots = 64;
+	static const int Overflow = MaxSlots;
+};
+
+//-----------------------------------------------------------------------------
+// Thread-caching object pool. Each thread allocates from and frees to a pair
+// of magazines in its own cache without locking. Only when both are empty or
+// both are full does it exchange a whole magazine with the shared depot.
+// Every slot always holds a constructed object, so Allocate and Free reuse
+// objects as they are, while Construct and Destroy also reset them. Chunks
+// double in size up to MaxChunkSize objects.
+
 template <class T>
 class MEMORY_POOL
 {
 public:
 
 	MEMORY_POOL()
-		: NumAllocated(0)
+		: NextChunkSize(FirstChunkSize)
 	{
 	}
 
@@ -35,24 +80,39 @@ public:
 	T* Construct()
 	{
 		T* obj = Allocate();
-		return new (obj) T;
+		obj->~T();
+		new (obj) T;
+		obj->SetAllocated();
+		return obj;
 	}
 
 	void Destroy(T* obj)
 	{
-		obj.T::~T();
+		obj->~T();
+		new (obj) T;
+		obj->SetAllocated();
 		Free(obj);
 	}
 
 	T* Allocate()
 	{
-		if (FreeList.empty())
-			NewChunk();
-		T* obj = FreeList.back();
-		FreeList.pop_back();
+		const int slot = THREAD_SLOT::Get();
+		std::unique_lock<std::mutex> guard(OverflowLock, std::defer_lock);
+		if (slot == THREAD_SLOT::Overflow)
+			guard.lock();
+
+		CACHE& cache = Caches[slot];
+		if (cache.Loaded.empty())
+		{
+			if (cache.Previous.empty())
+				Refill(cache);
+			cache.Loaded.swap(cache.Previous);
+		}
+		T* obj = cache.Loaded.back();
+		cache.Loaded.pop_back();
 		assert(!obj->IsAllocated());
 		obj->SetAllocated();
-		NumAllocated++;
+		cache.NumAllocated++;
 		return obj;
 	}
 
@@ -60,44 +120,141 @@ public:
 	{
 		assert(obj->IsAllocated());
 		obj->ClearAllocated();
-		FreeList.push_back(obj);
-		NumAllocated--;
+
+		const int slot = THREAD_SLOT::Get();
+		std::unique_lock<std::mutex> guard(OverflowLock, std::defer_lock);
+		if (slot == THREAD_SLOT::Overflow)
+			guard.lock();
+
+		CACHE& cache = Caches[slot];
+		if ((int) cache.Loaded.size() == MagazineSize)
+		{
+			if ((int) cache.Previous.size() == MagazineSize)
+				Flush(cache);
+			cache.Loaded.swap(cache.Previous);
+		}
+		cache.Loaded.push_back(obj);
+		cache.NumAllocated--;
 	}
 
+	// Must not be called while other threads are using the pool
 	void DeleteAll()
 	{
 		for (ChunkIterator i_chunk = Chunks.begin(); i_chunk != Chunks.end(); ++i_chunk)
-			delete *i_chunk;
+		{
+			for (int i = 0; i < i_chunk->Size; ++i)
+				i_chunk->Objects[i].~T();
+			CHUNK_MEMORY::Free(i_chunk->Objects, i_chunk->Size * sizeof(T));
+		}
 		Chunks.clear();
-		FreeList.clear();
-		NumAllocated = 0;
+		NextChunkSize = FirstChunkSize;
+		Full.clear();
+		Empty.clear();
+		for (int i = 0; i <= THREAD_SLOT::MaxSlots; ++i)
+		{
+			Caches[i].Loaded.clear();
+			Caches[i].Previous.clear();
+			Caches[i].NumAllocated = 0;
+		}
 	}
 
-	int GetNumAllocated() const { return NumAllocated; }
+	// Objects may be freed on a different thread than allocated them, so
+	// only the total over all caches is meaningful. It is exact when no
+	// other thread is using the pool
+	int GetNumAllocated() const
+	{
+		int numAllocated = 0;
+		for (int i = 0; i <= THREAD_SLOT::MaxSlots; ++i)
+			numAllocated += Caches[i].NumAllocated;
+		return numAllocated;
+	}
 
 private:
 
+	typedef std::vector<T*> MAGAZINE;
+
+	struct CACHE
+	{
+		CACHE() : NumAllocated(0) { }
+
+		MAGAZINE Loaded;
+		MAGAZINE Previous;
+		int NumAllocated;
+
+		// Keeps caches of different threads on separate cache lines
+		char Padding[64];
+	};
+
 	struct CHUNK
 	{
-		static const int Size = 256;
-		T Objects[Size];
+		T* Objects;
+		int Size;
 	};
 
+	static const int MagazineSize = 64;
+	static const int FirstChunkSize = 256;
+	static const int MaxChunkSize = 65536;
+
+	// Replaces the empty previous magazine with a full one from the depot
+	void Refill(CACHE& cache)
+	{
+		std::lock_guard<std::mutex> guard(DepotLock);
+		if (Full.empty())
+			NewChunk();
+		Empty.push_back(MAGAZINE());
+		Empty.back().swap(cache.Previous);
+		cache.Previous.swap(Full.back());
+		Full.pop_back();
+	}
+
+	// Replaces the full previous magazine with an empty one from the depot
+	void Flush(CACHE& cache)
+	{
+		std::lock_guard<std::mutex> guard(DepotLock);
+		Full.push_back(MAGAZINE());
+		Full.back().swap(cache.Previous);
+		if (!Empty.empty())
+		{
+			cache.Previous.swap(Empty.back());
+			Empty.pop_back();
+		}
+		else
+			cache.Previous.reserve(MagazineSize);
+	}
+
 	void NewChunk()
 	{
-		CHUNK* chunk = new CHUNK;
+		CHUNK chunk;
+		chunk.Size = NextChunkSize;
+		chunk.Objects = static_cast<T*>(CHUNK_MEMORY::Allocate(chunk.Size * sizeof(T)));
+		for (int i = 0; i < chunk.Size; ++i)
+			new (&chunk.Objects[i]) T;
 		Chunks.push_back(chunk);
-		for (int i = CHUNK::Size - 1; i >= 0; --i)
+		if (NextChunkSize < MaxChunkSize)
+			NextChunkSize *= 2;
+
+		for (int begin = chunk.Size - MagazineSize; begin >= 0; begin -= MagazineSize)
 		{
-			FreeList.push_back(&chunk->Objects[i]);
-			chunk->Objects[i].ClearAllocated();
+			Full.push_back(MAGAZINE());
+			MAGAZINE& magazine = Full.back();
+			magazine.reserve(MagazineSize);
+			for (int i = begin + MagazineSize - 1; i >= begin; --i)
+			{
+				magazine.push_back(&chunk.Objects[i]);
+				chunk.Objects[i].ClearAllocated();
+			}
 		}
 	}
 
-	std::vector<CHUNK*> Chunks;
-	std::vector<T*> FreeList;
-	int NumAllocated;
-	typedef typename std::vector<CHUNK*>::iterator ChunkIterator;
+	CACHE Caches[THREAD_SLOT::MaxSlots + 1];
+	std::mutex OverflowLock;
+
+	std::vector<CHUNK> Chunks;
+	int NextChunkSize;
+	std::vector<MAGAZINE> Full;
+	std::vector<MAGAZINE> Empty;
+	std::mutex DepotLock;
+	typedef typename std::vector<CHUNK>::iterator ChunkIterator;
 };
 
 #endif // MEMORY_POOL_H
@@ -8,34 +8,61 @@ using namespace std;
 
 int QNODE::NumChildren = 0;
 
-void QNODE::Initialise()
-{
-	initialized = true;
-	ChildrenCount = 0;
-	assert(NumChildren);
-	Children.resize(NumChildren);
-	//VisitCounts.resize(NumChildren);
-	for (int observation = 0; observation < QNODE::NumChildren; observation++)
-	{
-		Children[observation] = 0;
-		VisitCounts.push_back(0);
-	}
-	AlphaData.AlphaSum.clear();
+VNODE* QNODE::Child(int c) const
+{
+	uint32_t handle = Parent->ChildHandles[Action * NumChildren + c];
+	return handle == VNODE_POOL::NoHandle ? 0 : VNODE::VNodePool.Get(handle);
+}
+
+void QNODE::SetChild(int c, VNODE* vnode) const
+{
+	Parent->ChildHandles[Action * NumChildren + c] =
+		vnode ? vnode->Handle : VNODE_POOL::NoHandle;
+}
+
+ALPHA& QNODE::Alpha() const
+{
+	assert(VNODE::UseAlpha);
+	return Parent->AlphaData[Action];
+}
+
+void QNODE::IncrementChildrenCount(const int observation) const
+{
+	assert(VNODE::UseObservationCounts);
+	int& visitCount = Parent->ObservationCounts[Action * NumChildren + observation];
+	if (visitCount == 0)
+		Parent->ChildrenCounts[Action]++;
+	visitCount++;
+}
+
+int QNODE::GetVisitCount(const int c) const
+{
+	if (!VNODE::UseObservationCounts)
+		return 0;
+	return Parent->ObservationCounts[Action * NumChildren + c];
+}
+
+int QNODE::GetChildrenCount() const
+{
+	if (!VNODE::UseObservationCounts)
+		return 0;
+	return Parent->ChildrenCounts[Action];
 }
 
 void QNODE::DisplayValue(HISTORY& history, int maxDepth, ostream& ostr) const
 {
 	history.Display(ostr);
-	ostr << ": " << Value.GetValue() << " (" << Value.GetCount() << ")\n";
+	ostr << ": " << Parent->ChildValues.GetValue(Action)
+		<< " (" << Parent->ChildValues.GetCount(Action) << ")\n";
 	if (history.Size() >= maxDepth)
 		return;
 
 	for (int observation = 0; observation < NumChildren; observation++)
 	{
-		if (Children[observation])
+		if (Child(observation))
 		{
-			history.Back().Observation = observation;
-			Children[observation]->DisplayValue(history, maxDepth, ostr);
+			history.SetObservation(observation);
+			Child(observation)->DisplayValue(history, maxDepth, ostr);
 		}
 	}
 }
@@ -43,37 +70,55 @@ void QNODE::DisplayValue(HISTORY& history, int maxDepth, ostream& ostr) const
 void QNODE::DisplayPolicy(HISTORY& history, int maxDepth, ostream& ostr) const
 {
 	history.Display(ostr);
-	ostr << ": " << Value.GetValue() << " (" << Value.GetCount() << ")\n";
+	ostr << ": " << Parent->ChildValues.GetValue(Action)
+		<< " (" << Parent->ChildValues.GetCount(Action) << ")\n";
 	if (history.Size() >= maxDepth)
 		return;
 
 	for (int observation = 0; observation < NumChildren; observation++)
 	{
-		if (Children[observation])
+		if (Child(observation))
 		{
-			history.Back().Observation = observation;
-			Children[observation]->DisplayPolicy(history, maxDepth, ostr);
+			history.SetObservation(observation);
+			Child(observation)->DisplayPolicy(history, maxDepth, ostr);
 		}
 	}
 }
 
 //-----------------------------------------------------------------------------
 
-MEMORY_POOL<VNODE> VNODE::VNodePool;
+VNODE_POOL VNODE::VNodePool;
 
 int VNODE::NumChildren = 0;
+bool VNODE::UseAMAF = false;
+bool VNODE::UseAlpha = false;
+bool VNODE::UseObservationCounts = false;
 
 void VNODE::Initialise()
 {
-	assert(NumChildren);
-	Children.resize(VNODE::NumChildren);
-	for (int action = 0; action < VNODE::NumChildren; action++)
-		Children[action].Initialise();
+	assert(NumChildren && QNODE::NumChildren);
+	ChildValues.Resize(NumChildren);
+	ChildAMAF.Resize(UseAMAF ? NumChildren : 0);
+	ChildHandles.assign(NumChildren * QNODE::NumChildren, VNODE_POOL::NoHandle);
+	if (UseObservationCounts)
+	{
+		ObservationCounts.assign(NumChildren * QNODE::NumChildren, 0);
+		ChildrenCounts.assign(NumChildren, 0);
+	}
+	if (UseAlpha)
+	{
+		AlphaData.resize(NumChildren);
+		for (int action = 0; action < NumChildren; action++)
+			AlphaData[action].AlphaSum.clear();
+	}
 }
 
-VNODE* VNODE::Create()
+VNODE* VNODE::Create(const SIMULATOR& simulator)
 {
 	VNODE* vnode = VNodePool.Allocate();
+	// Nodes from a released tree still hold their particles
+	if (!vnode->BeliefState.Empty())
+		vnode->BeliefState.Free(simulator);
 	vnode->Initialise();
 	return vnode;
 }
@@ -82,25 +127,65 @@ void VNODE::Free(VNODE* vnode, const SIMULATOR& simulator)
 {
 	vnode->BeliefState.Free(simulator);
 	VNodePool.Free(vnode);
-	for (int action = 0; action < VNODE::NumChildren; action++)
-		for (int observation = 0; observation < QNODE::NumChildren; observation++)
-			if (vnode->Child(action).Child(observation))
-				Free(vnode->Child(action).Child(observation), simulator);
+	for (std::vector<uint32_t>::const_iterator i_child = vnode->ChildHandles.begin();
+		i_child != vnode->ChildHandles.end(); ++i_child)
+		if (*i_child != VNODE_POOL::NoHandle)
+			Free(VNodePool.Get(*i_child), simulator);
+}
+
+// Frees a tree apart from one subtree directly below its root
+void VNODE::FreeExcept(VNODE* vnode, VNODE* keep, const SIMULATOR& simulator)
+{
+	vnode->BeliefState.Free(simulator);
+	VNodePool.Free(vnode);
+	for (std::vector<uint32_t>::const_iterator i_child = vnode->ChildHandles.begin();
+		i_child != vnode->ChildHandles.end(); ++i_child)
+		if (*i_child != VNODE_POOL::NoHandle && VNodePool.Get(*i_child) != keep)
+			Free(VNodePool.Get(*i_child), simulator);
+}
+
+void VNODE::FreeTree()
+{
+	VNodePool.Rewind();
+}
+
+void VNODE::FreeAll(const SIMULATOR& simulator)
+{
+	VNodePool.DeleteAll(&simulator);
 }
 
-void VNODE::FreeAll()
+int VNODE::GetNumAllocated()
 {
-	VNodePool.DeleteAll();
+	return VNodePool.GetNumAllocated();
+}
+
+// Approximate memory used by one node and its per-action arrays, not
+// counting its particles
+size_t VNODE::GetNodeBytes()
+{
+	size_t bytes = sizeof(VNODE);
+	bytes += NumChildren * (sizeof(int) + 2 * sizeof(double));
+	if (UseAMAF)
+		bytes += NumChildren * 3 * sizeof(double);
+	bytes += NumChildren * QNODE::NumChildren * sizeof(uint32_t);
+	if (UseObservationCounts)
+		bytes += (NumChildren * QNODE::NumChildren + NumChildren) * sizeof(int);
+	if (UseAlpha)
+		bytes += NumChildren * sizeof(ALPHA);
+	return bytes;
 }
 
 void VNODE::SetChildren(int count, double value)
 {
 	for (int action = 0; action < NumChildren; action++)
-	{
-		QNODE& qnode = Children[action];
-		qnode.Value.Set(count, value);
-		qnode.AMAF.Set(count, value);
-	}
+		SetChildValue(action, count, value);
+}
+
+void VNODE::SetChildValue(int action, double count, double value)
+{
+	ChildValues.Set(action, count, value);
+	if (UseAMAF)
+		ChildAMAF.Set(action, count, value);
 }
 
 void VNODE::DisplayValue(HISTORY& history, int maxDepth, ostream& ostr) const
@@ -111,7 +196,7 @@ void VNODE::DisplayValue(HISTORY& history, int maxDepth, ostream& ostr) const
 	for (int action = 0; action < NumChildren; action++)
 	{
 		history.Add(action);
-		Children[action].DisplayValue(history, maxDepth, ostr);
+		QNODE(const_cast<VNODE*>(this), action).DisplayValue(history, maxDepth, ostr);
 		history.Pop();
 	}
 }
@@ -125,19 +210,110 @@ void VNODE::DisplayPolicy(HISTORY& history, int maxDepth, ostream& ostr) const
 	int besta = -1;
 	for (int action = 0; action < NumChildren; action++)
 	{
-		if (Children[action].Value.GetValue() > bestq)
+		if (ChildValues.GetValue(action) > bestq)
 		{
 			besta = action;
-			bestq = Children[action].Value.GetValue();
+			bestq = ChildValues.GetValue(action);
 		}
 	}
 
 	if (besta != -1)
 	{
 		history.Add(besta);
-		Children[besta].DisplayPolicy(history, maxDepth, ostr);
+		QNODE(const_cast<VNODE*>(this), besta).DisplayPolicy(history, maxDepth, ostr);
 		history.Pop();
 	}
 }
 
 //-----------------------------------------------------------------------------
+
+const uint32_t VNODE_POOL::NoHandle;
+
+VNODE_POOL::VNODE_POOL()
+	: NumUsed(0),
+	Capacity(0),
+	NumAllocated(0),
+	Generation(1)
+{
+}
+
+VNODE_POOL::~VNODE_POOL()
+{
+	DeleteAll();
+}
+
+VNODE* VNODE_POOL::Allocate()
+{
+	VNODE* vnode;
+	if (!FreeList.empty())
+	{
+		vnode = FreeList.back();
+		FreeList.pop_back();
+	}
+	else
+	{
+		if (NumUsed == Capacity)
+		{
+			const int chunkSize = GetChunkSize(Chunks.size());
+			VNODE* chunk = static_cast<VNODE*>(
+				CHUNK_MEMORY::Allocate(chunkSize * sizeof(VNODE)));
+			for (int i = 0; i < chunkSize; ++i)
+			{
+				new (&chunk[i]) VNODE;
+				chunk[i].ClearAllocated();
+				chunk[i].Handle = Capacity + i + 1;
+				chunk[i].Generation = 0;
+			}
+			Chunks.push_back(chunk);
+			Capacity += chunkSize;
+		}
+		NumUsed++;
+		vnode = Get(NumUsed);
+		assert(vnode->Handle == (uint32_t)NumUsed);
+	}
+	assert(!IsLive(vnode));
+	vnode->SetAllocated();
+	vnode->Generation = Generation;
+	NumAllocated++;
+	return vnode;
+}
+
+void VNODE_POOL::Free(VNODE* vnode)
+{
+	assert(IsLive(vnode));
+	vnode->ClearAllocated();
+	FreeList.push_back(vnode);
+	NumAllocated--;
+}
+
+void VNODE_POOL::Rewind()
+{
+	// Nodes keep their children and particles until reused
+	Generation++;
+	FreeList.clear();
+	NumUsed = 0;
+	NumAllocated = 0;
+}
+
+// Particles still held by any node, live or stale, are returned to simulator
+void VNODE_POOL::DeleteAll(const SIMULATOR* simulator)
+{
+	for (int chunk = 0; chunk < (int)Chunks.size(); ++chunk)
+	{
+		const int chunkSize = GetChunkSize(chunk);
+		for (int i = 0; i < chunkSize; ++i)
+		{
+			if (simulator && !Chunks[chunk][i].BeliefState.Empty())
+				Chunks[chunk][i].BeliefState.Free(*simulator);
+			Chunks[chunk][i].~VNODE();
+		}
+		CHUNK_MEMORY::Free(Chunks[chunk], chunkSize * sizeof(VNODE));
+	}
+	Chunks.clear();
+	FreeList.clear();
+	NumUsed = 0;
+	Capacity = 0;
+	NumAllocated = 0;
+}
+
+//-----------------------------------------------------------------------------
@@ -4,6 +4,7 @@
 #include "beliefstate.h"
 #include "utils.h"
 #include <iostream>
+#include <stdint.h>
 
 class HISTORY;
 class SIMULATOR;
@@ -69,85 +70,216 @@ private:
 };
 
 //-----------------------------------------------------------------------------
+// Per-action statistics of a VNODE, stored as parallel arrays so that action
+// selection scans contiguous counts and totals
+
+template<class COUNT>
+class VALUE_ARRAY
+{
+public:
+
+	void Resize(int size)
+	{
+		Count.resize(size);
+		Total.resize(size);
+		SquaredTotal.resize(size);
+	}
+
+	bool Empty() const { return Count.empty(); }
+	int Size() const { return Count.size(); }
+
+	void Set(int i, double count, double value)
+	{
+		Count[i] = count;
+		Total[i] = value * count;
+		SquaredTotal[i] = value*value*count;
+	}
+
+	void Add(int i, double totalReward)
+	{
+		Count[i] += 1.0;
+		Total[i] += totalReward;
+		SquaredTotal[i] += totalReward*totalReward;
+	}
+
+	void Add(int i, double totalReward, COUNT weight)
+	{
+		Count[i] += weight;
+		Total[i] += totalReward * weight;
+	}
+
+	double GetValue(int i) const
+	{
+		return Count[i] == 0 ? Total[i] : Total[i] / Count[i];
+	}
+
+	COUNT GetCount(int i) const
+	{
+		return Count[i];
+	}
+
+	double GetSquaredValue(int i) const
+	{
+		return SquaredTotal[i];
+	}
+
+	const COUNT* Counts() const { return &Count[0]; }
+	const double* Totals() const { return &Total[0]; }
+	const double* SquaredTotals() const { return &SquaredTotal[0]; }
+
+private:
+
+	std::vector<COUNT> Count;
+	std::vector<double> Total;
+	std::vector<double> SquaredTotal;
+};
+
+//-----------------------------------------------------------------------------
+// Lightweight view of one action of a VNODE. All per-action data lives in
+// the parent node; children are stored there as 32-bit pool handles.
 
 class QNODE
 {
 public:
 
-	VALUE<int> Value;
-	VALUE<double> AMAF;
-	double LowerBound;
-	double UpperBound;
-	int VisitCount;
-	void Initialise();
-	double Weight() const;
-	double Gap() const { return UpperBound - LowerBound; }
-	VNODE*& Child(int c) { return Children[c]; }
-	VNODE* Child(int c) const { return Children[c]; }
-	ALPHA& Alpha() { return AlphaData; }
-	const ALPHA& Alpha() const { return AlphaData; }
-	void IncrementChildrenCount(const int observation)
-	{
-		if(!initialized)
-		{
-			Initialise();
-		}
-		if(VisitCounts[observation] == 0)
-		{
-			ChildrenCount++;
-		}
-		VisitCounts[observation]++;
+	QNODE(VNODE* parent, int action)
+		: Parent(parent),
+		Action(action)
+	{
 	}
-	const int GetVisitCount(const int c) const { return VisitCounts[c]; }
-	const int GetChildrenCount() const { return ChildrenCount; }
+
+	VNODE* Child(int c) const;
+	void SetChild(int c, VNODE* vnode) const;
+	ALPHA& Alpha() const;
+	void IncrementChildrenCount(const int observation) const;
+	int GetVisitCount(const int c) const;
+	int GetChildrenCount() const;
+	int GetAction() const { return Action; }
 	void DisplayValue(HISTORY& history, int maxDepth, std::ostream& ostr) const;
 	void DisplayPolicy(HISTORY& history, int maxDepth, std::ostream& ostr) const;
-	bool IsLeaf() const { return Children.empty(); }
 	static int NumChildren;
+
 private:
-	bool initialized = false;
-	std::vector<int> VisitCounts;
-	std::vector<VNODE*> Children;
-	int ChildrenCount;
-	ALPHA AlphaData;
-	friend class VNODE;
+	VNODE* Parent;
+	int Action;
 };
 
 //-----------------------------------------------------------------------------
 
+class VNODE_POOL;
+
 class VNODE : public MEMORY_OBJECT
 {
 public:
 	VALUE<int> Value;
-	double LowerBound;
-	double UpperBound;
-	int VisitCount;
+	VALUE_ARRAY<int> ChildValues;
+	VALUE_ARRAY<double> ChildAMAF;
 	void Initialise();
-	static VNODE* Create();
+	static VNODE* Create(const SIMULATOR& simulator);
 	static void Free(VNODE* vnode, const SIMULATOR& simulator);
-	static void FreeAll();
+	static void FreeExcept(VNODE* vnode, VNODE* keep, const SIMULATOR& simulator);
+	static void FreeTree();
+	static void FreeAll(const SIMULATOR& simulator);
+	static int GetNumAllocated();
+	static size_t GetNodeBytes();
 	double Weight() const { return BeliefState.GetNumScenarios()/500.0; }
-	double Gap() const { return UpperBound - LowerBound; }
-	QNODE& Child(int c) { return Children[c]; }
-	const QNODE& Child(int c) const { return Children[c]; }
+	QNODE Child(int c) { return QNODE(this, c); }
 	BELIEF_STATE& Beliefs() { return BeliefState; }
 	const BELIEF_STATE& Beliefs() const { return BeliefState; }
-	bool IsLeaf() const { return Children.empty(); }
+	bool IsLeaf() const { return ChildHandles.empty(); }
 	void setBeliefs(BELIEF_STATE& newBelief)
 	{
 		BeliefState = newBelief;
 	}
 
 	void SetChildren(int count, double value);
+	void SetChildValue(int action, double count, double value);
 
 	void DisplayValue(HISTORY& history, int maxDepth, std::ostream& ostr) const;
 	void DisplayPolicy(HISTORY& history, int maxDepth, std::ostream& ostr) const;
 
 	static int NumChildren;
+
+	// Optional per-action data, only allocated when the feature is in use
+	static bool UseAMAF;
+	static bool UseAlpha;
+	static bool UseObservationCounts;
+
 private:
-	std::vector<QNODE> Children;
+	std::vector<uint32_t> ChildHandles;
+	std::vector<int> ObservationCounts;
+	std::vector<int> ChildrenCounts;
+	std::vector<ALPHA> AlphaData;
 	BELIEF_STATE BeliefState;
-	static MEMORY_POOL<VNODE> VNodePool;
+	uint32_t Handle;
+	unsigned Generation;
+	static VNODE_POOL VNodePool;
+	friend class QNODE;
+	friend class VNODE_POOL;
+};
+
+//-----------------------------------------------------------------------------
+// Generational pool for search tree nodes. Nodes are handed out from fixed
+// chunks with a bump index; releasing a whole tree bumps the generation and
+// rewinds the index, so stale nodes are only reinitialised, and their
+// particles returned, when reused. Releasing a tree never visits its nodes.
+// Chunks double in size up to MaxChunkSize nodes, and a handle is the index
+// of a node across all chunks plus one.
+
+class VNODE_POOL
+{
+public:
+
+	VNODE_POOL();
+	~VNODE_POOL();
+
+	VNODE* Allocate();
+	void Free(VNODE* vnode);
+
+	VNODE* Get(uint32_t handle) const
+	{
+		assert(handle != NoHandle);
+		uint32_t index = handle - 1;
+		if (index < NumGrowingNodes)
+		{
+			// Chunk k starts at FirstChunkSize * (2^k - 1)
+			int chunk = 31 - __builtin_clz(index / FirstChunkSize + 1);
+			return &Chunks[chunk][index - FirstChunkSize * ((1u << chunk) - 1)];
+		}
+		index -= NumGrowingNodes;
+		return &Chunks[NumGrowingChunks + index / MaxChunkSize][index % MaxChunkSize];
+	}
+
+	void Rewind();
+	void DeleteAll(const SIMULATOR* simulator = 0);
+
+	bool IsLive(const VNODE* vnode) const
+	{
+		return vnode->IsAllocated() && vnode->Generation == Generation;
+	}
+
+	int GetNumAllocated() const { return NumAllocated; }
+
+	static const uint32_t NoHandle = 0;
+
+private:
+
+	static const uint32_t FirstChunkSize = 256;
+	static const int NumGrowingChunks = 9;
+	static const uint32_t MaxChunkSize = FirstChunkSize << (NumGrowingChunks - 1);
+	static const uint32_t NumGrowingNodes = FirstChunkSize * ((1u << NumGrowingChunks) - 1);
+
+	int GetChunkSize(int chunk) const
+	{
+		return chunk < NumGrowingChunks ? FirstChunkSize << chunk : MaxChunkSize;
+	}
+
+	std::vector<VNODE*> Chunks;
+	std::vector<VNODE*> FreeList;
+	int NumUsed;
+	int Capacity;
+	int NumAllocated;
+	unsigned Generation;
 };
 
 #endif // NODE_H
@@ -1,5 +1,7 @@
 #include "planner.h"
 
+const uint32_t OpenLoopArena::NoChild;
+
 int POSTS::SelectAction()
 {
 	int banditIndex = currentIndex%Params.MaxDepth;
@@ -16,7 +18,7 @@ void POSTS::Rollout()
 	assert(BeliefState().GetNumSamples() > 0);
 	for (int i = 0; i < Params.NumSimulations; i++)
 	{
-		std::vector<int> legalActions;
+		ACTION_SET legalActions;
 		STATE* state = Root->Beliefs().CreateSample(Simulator);
 		int banditIndex = currentIndex%Params.MaxDepth;
 		int action = SampleAction(0, banditIndex, *state, legalActions);
@@ -26,23 +28,24 @@ void POSTS::Rollout()
 		double immediateReward, delayedReward, totalReward;
 		bool terminal = Simulator.Step(*state, action, observation, immediateReward);
 
-		VNODE*& vnode = Root->Child(action).Child(observation);
-		if (!vnode && !terminal)
+		QNODE qnode = Root->Child(action);
+		if (!qnode.Child(observation) && !terminal)
 		{
-			vnode = ExpandNode(state);
+			VNODE* vnode = ExpandNode(state);
 			AddSample(vnode, *state);
+			qnode.SetChild(observation, vnode);
 		}
 		History.Add(action, observation);
 		delayedReward = Rollout(*state, legalActions, 1,i);
 		totalReward = immediateReward + Simulator.GetDiscount() * delayedReward;
-		Root->Child(action).Value.Add(totalReward);
+		Root->ChildValues.Add(action, totalReward);
 		bandits[banditIndex]->update(totalReward);
 		Simulator.FreeState(state);
 		History.Truncate(historyDepth);
 	}
 }
 
-int POSTS::SampleAction(const int t, const int banditIndex, STATE& state, std::vector<int>& legalActions)
+int POSTS::SampleAction(const int t, const int banditIndex, STATE& state, ACTION_SET& legalActions)
 {
 	legalActions.clear();
 	if(Params.SelectionKnowledge == SIMULATOR::KNOWLEDGE::SMART && t < stackSize)
@@ -61,40 +64,37 @@ int POSTS::SampleAction(const int t, const int banditIndex, STATE& state, std::v
 	return bandits[banditIndex]->sampleFrom(legalActions);
 }
 
+// Plays the stack of bandits from depth t onwards without recursion, then backs up
+// the discounted returns into the bandits below the stack size in reverse order
 double POSTS::Rollout(
 	STATE& state,
-	std::vector<int>& legalActions,
+	ACTION_SET& legalActions,
 	const int t,
 	const int i)
 {
-	if (t >= Params.MaxDepth)
+	const double discount = Simulator.GetDiscount();
+	int depth = t;
+	for (; depth < Params.MaxDepth; depth++)
 	{
-		return 0;
-	}
-	int numberOfActions = Simulator.GetNumActions();
-	bool terminal = false;
-	int observation;
-	double immediateReward, delayedReward;
-	int banditIndex = (currentIndex + t)%Params.MaxDepth;
-	if (!terminal) {
-		int action = SampleAction(t, banditIndex, state, legalActions);
-		terminal = Simulator.Step(state, action, observation, immediateReward);
+		int observation;
+		int banditIndex = (currentIndex + depth)%Params.MaxDepth;
+		int action = SampleAction(depth, banditIndex, state, legalActions);
+		bool terminal = Simulator.Step(state, action, observation, rewards[depth]);
 		History.Add(action, observation);
-	}
-	if (terminal)
-	{
-		if(t < stackSize)
+		if (terminal)
 		{
-	    	bandits[banditIndex]->update(immediateReward);
+			depth++;
+			break;
 		}
-		return immediateReward;
 	}
-	double successorReturn = Rollout(state, legalActions, t+1,i);
-	double discount = Simulator.GetDiscount();
-	double returnValue = immediateReward + discount*successorReturn;
-	if(t < stackSize)
+	double returnValue = 0;
+	for (int step = depth - 1; step >= t; step--)
 	{
-		bandits[banditIndex]->update(returnValue);
+		returnValue = rewards[step] + discount*returnValue;
+		if(step < stackSize)
+		{
+			bandits[(currentIndex + step)%Params.MaxDepth]->update(returnValue);
+		}
 	}
 	return returnValue;
 }
@@ -117,9 +117,63 @@ void POOLTS::TreeSearch()
 	}
 }
 
-double POOLTS::Simulate(STATE& state, POOLTSNode* node, int t)
+// Open-loop pondering. Simulations step the committed action and continue
+// in the subtree below it, which the next SelectAction keeps as its root.
+// The root bandit is left alone since it is discarded anyway
+void POOLTS::Ponder(int action)
+{
+	if(rootNode == NULL || rootNode->IsLeaf())
+	{
+		return;
+	}
+	int historyDepth = History.Size();
+	POOLTSNode* child = GetNext(rootNode, action);
+	ponderedNode = arena.getChild(rootNode->getChildOffset(), action);
+	ponderedDepth = historyDepth + 1;
+	ponderedAction = action;
+	for (NumPondered = 0; NumPondered < Params.NumSimulations && !PonderStop; NumPondered++)
+	{
+		STATE* state = Root->Beliefs().CreateSample(Simulator);
+		Simulator.Validate(*state);
+		Status.Phase = SIMULATOR::STATUS::TREE;
+		TreeDepth = 1;
+		PeakTreeDepth = 1;
+		int observation;
+		double immediateReward;
+		if (!Simulator.Step(*state, action, observation, immediateReward))
+		{
+			History.Add(action, observation);
+			Simulate(*state, child, 1);
+		}
+		Simulator.FreeState(state);
+		History.Truncate(historyDepth);
+	}
+}
+
+uint32_t POOLTS::AllocateNode()
 {
-	std::vector<int> legal;
+	if(arena.exhausted())
+	{
+		arena.add(CreateNode());
+	}
+	return arena.allocate();
+}
+
+POOLTSNode* POOLTS::GetNext(POOLTSNode* node, const int action)
+{
+	const uint32_t offset = node->getChildOffset();
+	uint32_t child = arena.getChild(offset, action);
+	if(child == OpenLoopArena::NoChild)
+	{
+		child = AllocateNode();
+		arena.setChild(offset, action, child);
+	}
+	return arena.get(child);
+}
+
+int POOLTS::SelectTreeAction(STATE& state, POOLTSNode* node, int t)
+{
+	ACTION_SET legal;
 	if(Params.SelectionKnowledge == SIMULATOR::KNOWLEDGE::SMART && t > 0)
 	{
 		Simulator.GeneratePreferred(state, GetHistory(), legal, GetStatus());
@@ -128,44 +182,69 @@ double POOLTS::Simulate(STATE& state, POOLTSNode* node, int t)
 	if(Params.SelectionKnowledge != SIMULATOR::KNOWLEDGE::SMART || legal.empty()){
 		Simulator.GenerateLegal(state, GetHistory(), legal, GetStatus());
 	}
-    int action = node->getBandit()->sampleFrom(legal);
-	PeakTreeDepth = TreeDepth;
-    if (t >= Params.MaxDepth)
-    {
-    	return 0;
-    }
-    bool isLeaf = node->IsLeaf();
-    if(isLeaf)
-    {
-        node->Expand();
-		IncrementNodeCountBy(Simulator.GetNumActions());
-    }
-    int observation;
-    double immediateReward, delayedReward = 0;
-    bool terminal = Simulator.Step(state, action, observation, immediateReward);
-    if(t == 0)
-    {
-        VNODE*& vnode = Root->Child(action).Child(observation);
-        if (!vnode && !terminal) {
-            vnode = ExpandNode(&state);
-            AddSample(vnode, state);
-	}
-    }
-    History.Add(action, observation);
-    if(terminal)
-    {
-        node->Update(immediateReward);
-        return immediateReward;
-    }
-    assert(observation >= 0 && observation < Simulator.GetNumObservations());
-
-    TreeDepth++;
-    delayedReward = isLeaf? Rollout(state) : Simulate(state, node->getNext(action, pool), t+1);
-    TreeDepth--;
-
-    double totalReward = immediateReward + Simulator.GetDiscount() * delayedReward;
-    node->Update(totalReward);
-    return totalReward;
+	return node->getBandit()->sampleFrom(legal);
+}
+
+// Descends the open-loop tree without recursion, recording each visited node on the
+// path buffer, then backs up the discounted returns from the leaf to the root
+double POOLTS::Simulate(STATE& state, POOLTSNode* node, int t)
+{
+	const double discount = Simulator.GetDiscount();
+	const int treeDepth = TreeDepth;
+	double totalReward = 0;
+	path.clear();
+	while (true)
+	{
+		int action = SelectTreeAction(state, node, t);
+		PeakTreeDepth = TreeDepth;
+		if (t >= Params.MaxDepth)
+		{
+			break;
+		}
+		bool isLeaf = node->IsLeaf();
+		if(isLeaf)
+		{
+			node->Expand(arena.allocateChildren(Simulator.GetNumActions()));
+			IncrementNodeCountBy(Simulator.GetNumActions());
+		}
+		int observation;
+		double immediateReward;
+		bool terminal = Simulator.Step(state, action, observation, immediateReward);
+		if(t == 0)
+		{
+			QNODE qnode = Root->Child(action);
+			if (!qnode.Child(observation) && !terminal) {
+				VNODE* vnode = ExpandNode(&state);
+				AddSample(vnode, state);
+				qnode.SetChild(observation, vnode);
+			}
+		}
+		History.Add(action, observation);
+		PATH_ENTRY entry = { node, immediateReward };
+		path.push_back(entry);
+		if(terminal)
+		{
+			break;
+		}
+		assert(observation >= 0 && observation < Simulator.GetNumObservations());
+
+		TreeDepth++;
+		if(isLeaf)
+		{
+			totalReward = LeafValue(state);
+			break;
+		}
+		node = GetNext(node, action);
+		t++;
+	}
+	TreeDepth = treeDepth;
+
+	for (int index = path.size() - 1; index >= 0; index--)
+	{
+		totalReward = path[index].reward + discount * totalReward;
+		path[index].node->Update(totalReward);
+	}
+	return totalReward;
 }
 
 int SYMBOL::SelectAction()
@@ -179,7 +258,7 @@ void SYMBOL::Rollout()
 {
 	std::vector<double> totals(Simulator.GetNumActions(), 0.0);
 	int historyDepth = History.Size();
-	std::vector<int> legal;
+	ACTION_SET legal;
 	assert(BeliefState().GetNumSamples() > 0);
 	for (int i = 0; i < Params.NumSimulations; i++)
 	{
@@ -195,11 +274,12 @@ void SYMBOL::Rollout()
 		double immediateReward;
 		bool terminal = Simulator.Step(*state, action, observation, immediateReward);
 
-		VNODE*& vnode = Root->Child(action).Child(observation);
-		if (!vnode && !terminal)
+		QNODE qnode = Root->Child(action);
+		if (!qnode.Child(observation) && !terminal)
 		{
-			vnode = ExpandNode(state);
+			VNODE* vnode = ExpandNode(state);
 			AddSample(vnode, *state);
+			qnode.SetChild(observation, vnode);
 		}
 		History.Add(action, observation);
         rewards[0] = immediateReward;
@@ -222,7 +302,7 @@ void SYMBOL::Rollout()
             returnValue = rewards[t] + Simulator.GetDiscount()*returnValue;
             rewards[t] = returnValue;
         }
-		Root->Child(firstAction).Value.Add(rewards[0]);
+		Root->ChildValues.Add(firstAction, rewards[0]);
         bandits[0]->update(rewards[0]);
         bool predecessorConverged = bandits[0]->hasConverged(banditConvergenceEpsilon);
         int numberOfBandits = 1;
@@ -4,6 +4,7 @@
 #include "mabuc.h"
 #include <fstream>
 #include <list>
+#include <stdint.h>
 #include <algorithm>
 #include <iostream>
 
@@ -14,10 +15,13 @@ class POSTS : public MCTS
 public:
 	POSTS(const SIMULATOR& simulator, const PARAMS& params) : MCTS(simulator, params), currentIndex(0), stackSize(params.MaxDepth/5)
 	{
+		// Bandits are rebuilt for every action, so there is no search to keep
+		Params.Ponder = false;
 		for (int t = 0; t < Params.MaxDepth; t++)
 		{
 			bandits.push_back(new ThompsonSampling(Simulator.GetNumActions(), 0, 1, params.BanditBetaPrior));
 		}
+		rewards.assign(Params.MaxDepth, 0.0);
 	}
 	virtual ~POSTS()
 	{
@@ -40,14 +44,15 @@ public:
 	{
 		return Params.MaxDepth;
 	}
-	virtual int SampleAction(const int t, const int banditIndex, STATE& state, std::vector<int>& legalActions);
+	virtual int SampleAction(const int t, const int banditIndex, STATE& state, ACTION_SET& legalActions);
 	virtual int SelectAction();
-	double Rollout(STATE& state, std::vector<int>& legalActions, const int t, const int i);
+	double Rollout(STATE& state, ACTION_SET& legalActions, const int t, const int i);
 	void Rollout();
 protected:
 	int currentIndex;
 	const int stackSize;
 	std::vector<ThompsonSampling*> bandits;
+	std::vector<double> rewards;
 };
 
 class POOLTSNode
@@ -61,15 +66,6 @@ public:
     virtual ~POOLTSNode()
     {
 		delete bandit;
-        int children_size = children.size();
-        for(int index = 0; index < children_size; index++)
-        {
-            if(this->children[index] != NULL)
-	    {
-                delete this->children[index];
-	    }
-        }
-        this->children.clear();
     }
 
     virtual int SelectAction()
@@ -77,15 +73,9 @@ public:
         return this->bandit->play();
     }
 
-    void Expand()
+    void Expand(const uint32_t offset)
 	{
-		if(this->children.empty())
-		{
-			for(int index = 0; index < numberOfActions; index++)
-			{
-				this->children.push_back(NULL);
-			}
-		}
+		this->childOffset = offset;
         this->isLeafNode = false;
     }
 
@@ -104,27 +94,9 @@ public:
         bandit->update(reward);
     }
 
-    virtual POOLTSNode* getNext(const int action, std::list<POOLTSNode*>& pool)
+    const uint32_t getChildOffset() const
     {
-        POOLTSNode* child = children[action];
-		if(child == NULL)
-		{
-			if(!pool.empty())
-			{
-				child = pool.front();
-			pool.pop_front();
-			}
-			else
-			{
-				child = new POOLTSNode(Simulator, Params);
-			}
-			children[action] = child;
-		}
-		return child;
-    }
-    void resetNext(const int action)
-    {
-    	this->children[action] = NULL;
+        return this->childOffset;
     }
     const bool IsLeaf()
     {
@@ -135,60 +107,161 @@ public:
     	this->isLeafNode = true;
     	this->bandit->reset();
     }
-    void saveToPool(std::list<POOLTSNode*>& pool)
-    {
-		int numberOfChildren = this->children.size();
-			for(int index = 0; index < numberOfChildren; index++)
-		{
-				if(this->children[index] != NULL)
-			{
-					this->children[index]->saveToPool(pool);
-			}
-		}
-		this->children.clear();
-		this->reset();
-		pool.push_back(this);
-    }
 protected:
     Bandit* bandit;
-    std::vector<POOLTSNode*> children;
+    uint32_t childOffset = 0;
     bool isLeafNode = true;
     const int numberOfActions;
     const SIMULATOR& Simulator;
     const MCTS::PARAMS& Params;
 };
 
+/**
+ * Arena for open-loop search trees. Nodes are addressed by 32-bit indices and the
+ * children of every expanded node occupy a contiguous block of the child slab.
+ * Nodes are constructed once and recycled, so releasing a whole tree is a rewind.
+ */
+class OpenLoopArena
+{
+public:
+    static const uint32_t NoChild = 0; // index 0 always holds the root
+
+    OpenLoopArena() : usedNodes(0) {}
+
+    ~OpenLoopArena()
+    {
+        int numberOfNodes = nodes.size();
+        for(int index = 0; index < numberOfNodes; index++)
+        {
+            delete nodes[index];
+        }
+    }
+
+    void rewind()
+    {
+        usedNodes = 0;
+        children.clear();
+    }
+
+    // Makes the subtree below index the whole tree, with index as the new root.
+    // Kept nodes are renumbered in breadth-first order, all others are recycled
+    void retain(const uint32_t index, const int numberOfActions)
+    {
+        std::vector<POOLTSNode*> kept(1, nodes[index]);
+        std::vector<uint32_t> keptChildren;
+        std::vector<bool> isKept(usedNodes, false);
+        isKept[index] = true;
+        for(uint32_t next = 0; next < kept.size(); next++)
+        {
+            POOLTSNode* node = kept[next];
+            if(node->IsLeaf())
+            {
+                continue;
+            }
+            const uint32_t offset = node->getChildOffset();
+            const uint32_t keptOffset = keptChildren.size();
+            keptChildren.resize(keptOffset + numberOfActions, NoChild);
+            for(int action = 0; action < numberOfActions; action++)
+            {
+                const uint32_t child = children[offset + action];
+                if(child != NoChild)
+                {
+                    keptChildren[keptOffset + action] = kept.size();
+                    kept.push_back(nodes[child]);
+                    isKept[child] = true;
+                }
+            }
+            node->Expand(keptOffset);
+        }
+        const uint32_t numberOfKept = kept.size();
+        for(uint32_t i = 0; i < nodes.size(); i++)
+        {
+            if(i >= usedNodes || !isKept[i])
+            {
+                kept.push_back(nodes[i]);
+            }
+        }
+        nodes.swap(kept);
+        children.swap(keptChildren);
+        usedNodes = numberOfKept;
+    }
+
+    bool exhausted() const
+    {
+        return usedNodes == nodes.size();
+    }
+
+    void add(POOLTSNode* node)
+    {
+        nodes.push_back(node);
+    }
+
+    // Hands out the next recycled node, reset lazily on reuse
+    uint32_t allocate()
+    {
+        assert(!exhausted());
+        nodes[usedNodes]->reset();
+        return usedNodes++;
+    }
+
+    uint32_t allocateChildren(const int numberOfActions)
+    {
+        uint32_t offset = children.size();
+        children.resize(offset + numberOfActions, NoChild);
+        return offset;
+    }
+
+    POOLTSNode* get(const uint32_t index)
+    {
+        return nodes[index];
+    }
+
+    uint32_t getChild(const uint32_t offset, const int action) const
+    {
+        return children[offset + action];
+    }
+
+    void setChild(const uint32_t offset, const int action, const uint32_t child)
+    {
+        children[offset + action] = child;
+    }
+private:
+    uint32_t usedNodes;
+    std::vector<POOLTSNode*> nodes;
+    std::vector<uint32_t> children;
+};
+
 /**
  * Standard open-loop MCTS. Can traverse the search tree using human knowledge in form of preferred actions. 
  */
 class POOLTS : public MCTS
 {
 public:
-    POOLTS(const SIMULATOR& simulator, const PARAMS& params) : MCTS(simulator, params)
+    POOLTS(const SIMULATOR& simulator, const PARAMS& params) : MCTS(simulator, params), rootNode(NULL), openLoopNodeCount(1),
+		ponderedNode(OpenLoopArena::NoChild), ponderedDepth(0), ponderedAction(0)
     {
-    	this->rootNode = new POOLTSNode(simulator, params);
+		path.reserve(params.MaxDepth + 1);
     }
     virtual ~POOLTS()
+    {}
+    virtual int SelectAction()
     {
-        delete rootNode;
-		int pool_size = pool.size();
-		for(int index = 0; index < pool_size; index++)
+		// Continue below the pondered action if that is the step just taken
+		if(ponderedNode != OpenLoopArena::NoChild && History.Size() == ponderedDepth
+			&& History.Back().Action == ponderedAction)
 		{
-			POOLTSNode* next = pool.front();
-			delete next;
-			pool.pop_front();
+			arena.retain(ponderedNode, Simulator.GetNumActions());
+			rootNode = arena.get(0);
 		}
-		pool.clear();
-    }
-    virtual int SelectAction()
-    {
+		else
+		{
+			arena.rewind();
+			rootNode = arena.get(AllocateNode());
+		}
+		ponderedNode = OpenLoopArena::NoChild;
 		TreeSearch();
 		int action = rootNode->SelectAction();
-		rootNode->saveToPool(pool);
-		rootNode = pool.front();
-		pool.pop_front();
 		IncrementNodeCountStatistics();
-		rootNode->reset();
 		return action;
     }
 	virtual void IncrementNodeCountBy(const int addition)
@@ -209,11 +282,33 @@ public:
 		return nodeCountStatistics.GetMean();
 	}
     virtual void TreeSearch();
-    virtual double Simulate(STATE& state, POOLTSNode* node, int t);
+    double Simulate(STATE& state, POOLTSNode* node, int t);
+    virtual int SelectTreeAction(STATE& state, POOLTSNode* node, int t);
 protected:
+    virtual POOLTSNode* CreateNode()
+    {
+        return new POOLTSNode(Simulator, Params);
+    }
+    virtual void Ponder(int action);
+    uint32_t AllocateNode();
+    POOLTSNode* GetNext(POOLTSNode* node, const int action);
+
+	// Node visited during the descent of one simulation and the immediate reward received there
+	struct PATH_ENTRY
+	{
+		POOLTSNode* node;
+		double reward;
+	};
     POOLTSNode* rootNode;
-    std::list<POOLTSNode*> pool;
+    OpenLoopArena arena;
+	std::vector<PATH_ENTRY> path;
 	int openLoopNodeCount;
+
+	// Child of the last root below the committed action, searched while
+	// pondering, and the history size and action of the step that leads to it
+	uint32_t ponderedNode;
+	int ponderedDepth;
+	int ponderedAction;
 };
 
 class SYMBOL : public MCTS
@@ -221,6 +316,8 @@ class SYMBOL : public MCTS
 public:
 	SYMBOL(const SIMULATOR& simulator, const PARAMS& params) : MCTS(simulator, params), currentIndex(0), banditConvergenceEpsilon(params.BanditConvergenceEpsilon), maxNumberOfBandits(0)
 	{
+		// Bandits are rebuilt for every action, so there is no search to keep
+		Params.Ponder = false;
 		for (int t = 0; t < Params.MaxDepth; t++)
 		{
 			bandits.push_back(new ThompsonSampling(Simulator.GetNumActions(), Params.BanditArmCapacity, 1, params.BanditBetaPrior));
@@ -244,7 +341,7 @@ public:
         maxNumberOfBandits = 0;
 	}
 	virtual int SelectAction();
-	double Rollout(STATE& state, std::vector<int>& legalActions, const int t, const int i);
+	double Rollout(STATE& state, ACTION_SET& legalActions, const int t, const int i);
     const int getMaxNumberOfBandits()
     {
         return maxNumberOfBandits;
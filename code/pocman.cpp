@@ -147,7 +147,7 @@ STATE* POCMAN::CreateStartState() const
 	POCMAN_STATE* startState = MemoryPool.Allocate();
 	startState->GhostPos.resize(NumGhosts);
 	startState->GhostDir.resize(NumGhosts);
-	startState->Food.resize(Maze.GetXSize() * Maze.GetYSize());
+	startState->Food.Modify().resize(Maze.GetXSize() * Maze.GetYSize());
 	NewLevel(*startState);
 	return startState;
 }
@@ -155,6 +155,7 @@ STATE* POCMAN::CreateStartState() const
 void POCMAN::FreeState(STATE* state) const
 {
 	POCMAN_STATE* pocstate = safe_cast<POCMAN_STATE*>(state);
+	pocstate->Food.Release();
 	MemoryPool.Free(pocstate);
 }
 
@@ -219,9 +220,9 @@ bool POCMAN::Step(STATE& state, int action,
 	observation = MakeObservations(pocstate);
 
 	int pocIndex = Maze.Index(pocstate.PocmanPos);
-	if (pocstate.Food[pocIndex])
+	if (pocstate.Food.Get()[pocIndex])
 	{
-		pocstate.Food[pocIndex] = false;
+		pocstate.Food.Modify()[pocIndex] = false;
 		pocstate.NumFood--;
 		if (pocstate.NumFood == 0)
 		{
@@ -280,7 +281,7 @@ bool POCMAN::LocalMove(STATE& state, const HISTORY& history,
 			if (smellPos != COORD(0, 0) &&
 				Maze.Inside(pos) &&
 				CheckFlag(Maze(pos), E_SEED))
-				pocstate.Food[Maze.Index(pos)] = Bernoulli(FoodProb * 0.5);
+				pocstate.Food.Modify()[Maze.Index(pos)] = Bernoulli(FoodProb * 0.5);
 		}
 	}
 
@@ -390,6 +391,7 @@ void POCMAN::NewLevel(POCMAN_STATE& pocstate) const
 		pocstate.GhostDir[g] = -1;
 	}
 
+	vector<bool>& food = pocstate.Food.Modify();
 	pocstate.NumFood = 0;
 	for (int x = 0; x < Maze.GetXSize(); x++)
 	{
@@ -400,12 +402,12 @@ void POCMAN::NewLevel(POCMAN_STATE& pocstate) const
 				&& (CheckFlag(Maze(x, y), E_POWER)
 					|| Bernoulli(FoodProb)))
 			{
-				pocstate.Food[pocIndex] = 1;
+				food[pocIndex] = 1;
 				pocstate.NumFood++;
 			}
 			else
 			{
-				pocstate.Food[pocIndex] = 0;
+				food[pocIndex] = 0;
 			}
 		}
 	}
@@ -441,13 +443,52 @@ bool POCMAN::SmellFood(const POCMAN_STATE& pocstate) const
 	for (smellPos.X = -SmellRange; smellPos.X <= SmellRange; smellPos.X++)
 		for (smellPos.Y = -SmellRange; smellPos.Y <= SmellRange; smellPos.Y++)
 			if (Maze.Inside(pocstate.PocmanPos + smellPos)
-				&& pocstate.Food[Maze.Index(pocstate.PocmanPos + smellPos)])
+				&& pocstate.Food.Get()[Maze.Index(pocstate.PocmanPos + smellPos)])
 				return true;
 	return false;
 }
 
+uint64_t POCMAN::Hash(const STATE& state) const
+{
+	const POCMAN_STATE& pocstate = safe_cast<const POCMAN_STATE&>(state);
+	uint64_t hash = HashCombine(Maze.Index(pocstate.PocmanPos), pocstate.PowerSteps);
+	hash = HashCombine(hash, pocstate.NumFood);
+	for (int g = 0; g < NumGhosts; g++)
+	{
+		hash = HashCombine(hash, Maze.Index(pocstate.GhostPos[g]));
+		hash = HashCombine(hash, pocstate.GhostDir[g]);
+	}
+
+	// Pack the food bitmap into words before mixing it in
+	const vector<bool>& food = pocstate.Food.Get();
+	uint64_t word = 0;
+	for (int i = 0; i < (int) food.size(); i++)
+	{
+		word = word << 1 | food[i];
+		if (i % 64 == 63)
+		{
+			hash = HashCombine(hash, word);
+			word = 0;
+		}
+	}
+	return HashCombine(hash, word);
+}
+
+bool POCMAN::Equal(const STATE& state1, const STATE& state2) const
+{
+	const POCMAN_STATE& pocstate1 = safe_cast<const POCMAN_STATE&>(state1);
+	const POCMAN_STATE& pocstate2 = safe_cast<const POCMAN_STATE&>(state2);
+	return pocstate1.PocmanPos == pocstate2.PocmanPos
+		&& pocstate1.PowerSteps == pocstate2.PowerSteps
+		&& pocstate1.NumFood == pocstate2.NumFood
+		&& pocstate1.GhostPos == pocstate2.GhostPos
+		&& pocstate1.GhostDir == pocstate2.GhostDir
+		&& (&pocstate1.Food.Get() == &pocstate2.Food.Get()
+			|| pocstate1.Food.Get() == pocstate2.Food.Get());
+}
+
 void POCMAN::GenerateLegal(const STATE& state, const HISTORY& history,
-	vector<int>& legal, const STATUS& status) const
+	ACTION_SET& legal, const STATUS& status) const
 {
 	const POCMAN_STATE& pocstate = safe_cast<const POCMAN_STATE&>(state);
 
@@ -461,7 +502,7 @@ void POCMAN::GenerateLegal(const STATE& state, const HISTORY& history,
 }
 
 void POCMAN::GeneratePreferred(const STATE& state, const HISTORY& history,
-	vector<int>& actions, const STATUS& status) const
+	ACTION_SET& actions, const STATUS& status) const
 {
 	const POCMAN_STATE& pocstate = safe_cast<const POCMAN_STATE&>(state);
 	if (history.Size())
@@ -538,7 +579,7 @@ void POCMAN::DisplayState(const STATE& state, ostream& ostr) const
 			char c = ' ';
 			if (!Passable(pos))
 				c = 'X';
-			if (pocstate.Food[index])
+			if (pocstate.Food.Get()[index])
 				c = CheckFlag(Maze(x, y), E_POWER) ? '+' : '.';
 			for (int g = 0; g < NumGhosts; g++)
 				if (pos == pocstate.GhostPos[g])
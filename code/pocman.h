@@ -5,6 +5,7 @@
 #include "coord.h"
 #include "grid.h"
 #include "beliefstate.h"
+#include "copyonwrite.h"
 
 class POCMAN_STATE : public STATE
 {
@@ -13,7 +14,7 @@ public:
 	COORD PocmanPos;
 	std::vector<COORD> GhostPos;
 	std::vector<int> GhostDir;
-	std::vector<bool> Food; // bit vector
+	COPY_ON_WRITE<std::vector<bool> > Food; // bit vector, shared until eaten
 	int NumFood;
 	int PowerSteps;
 };
@@ -31,10 +32,14 @@ public:
 
 	virtual bool LocalMove(STATE& state, const HISTORY& history,
 		int stepObs, const STATUS& status) const;
+	virtual bool HasObservationLikelihood() const { return true; }
+	virtual bool HasStateHash() const { return true; }
+	virtual uint64_t Hash(const STATE& state) const;
+	virtual bool Equal(const STATE& state1, const STATE& state2) const;
 	void GenerateLegal(const STATE& state, const HISTORY& history,
-		std::vector<int>& legal, const STATUS& status) const;
+		ACTION_SET& legal, const STATUS& status) const;
 	void GeneratePreferred(const STATE& state, const HISTORY& history,
-		std::vector<int>& legal, const STATUS& status) const;
+		ACTION_SET& legal, const STATUS& status) const;
 
 	virtual void DisplayBeliefs(const BELIEF_STATE& beliefState,
 		std::ostream& ostr) const;
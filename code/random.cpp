@@ -1,13 +1,17 @@
 #include "random.h"
+#include "utils.h"
+
+// Draws from UTILS::Rand, so that threads with their own generator do not
+// share the C library one
 
 int randomInt(const int range) {
 	return randomInt(0, range);
 }
 
 int randomInt(const int min, const int range) {
-	return rand() % range + min;
+	return UTILS::Rand() % range + min;
 }
 
 double randomDouble() {
-	return ((double)rand()) / RAND_MAX;
+	return ((double)UTILS::Rand()) / RAND_MAX;
 }
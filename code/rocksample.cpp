@@ -1,9 +1,15 @@
 #include "rocksample.h"
 #include "utils.h"
+#include "beliefstate.h"
+#include <stdexcept>
+#include <type_traits>
 
 using namespace std;
 using namespace UTILS;
 
+static_assert(std::is_trivially_copyable<ROCKSAMPLE_STATE>::value,
+	"ROCKSAMPLE beliefs store states by value");
+
 ROCKSAMPLE::ROCKSAMPLE(int size, int rocks)
 	: Grid(size, size),
 	Size(size),
@@ -15,6 +21,9 @@ ROCKSAMPLE::ROCKSAMPLE(int size, int rocks)
 	NumObservations = 3;
 	RewardRange = 20;
 	Discount = 0.95;
+	StateSize = sizeof(ROCKSAMPLE_STATE);
+	if (NumRocks > ROCKSAMPLE_STATE::MaxRocks)
+		throw std::invalid_argument("ROCKSAMPLE: more rocks than ROCKSAMPLE_STATE::MaxRocks");
 
 	if (size == 7 && rocks == 8)
 		Init_7_8();
@@ -118,10 +127,9 @@ STATE* ROCKSAMPLE::CreateStartState() const
 {
 	ROCKSAMPLE_STATE* rockstate = MemoryPool.Allocate();
 	rockstate->AgentPos = StartPos;
-	rockstate->Rocks.clear();
 	for (int i = 0; i < NumRocks; i++)
 	{
-		ROCKSAMPLE_STATE::ENTRY entry;
+		ROCKSAMPLE_STATE::ENTRY& entry = rockstate->Rocks[i];
 		entry.Collected = false;
 		entry.Valuable = Bernoulli(0.5);
 		entry.Count = 0;
@@ -129,7 +137,6 @@ STATE* ROCKSAMPLE::CreateStartState() const
 		entry.ProbValuable = 0.5;
 		entry.LikelihoodValuable = 1.0;
 		entry.LikelihoodWorthless = 1.0;
-		rockstate->Rocks.push_back(entry);
 	}
 	//rockstate->Target = SelectTarget(*rockstate);
 	return rockstate;
@@ -264,8 +271,105 @@ bool ROCKSAMPLE::LocalMove(STATE& state, const HISTORY& history,
 	return true;
 }
 
+double ROCKSAMPLE::ObservationLikelihood(STATE& state, int action,
+	int stepObs, int observation) const
+{
+	if (action <= E_SAMPLE) // no sensor reading
+		return observation == E_NONE ? 1.0 : 0.0;
+
+	ROCKSAMPLE_STATE& rockstate = safe_cast<ROCKSAMPLE_STATE&>(state);
+	int rock = action - E_SAMPLE - 1;
+	ROCKSAMPLE_STATE::ENTRY& entry = rockstate.Rocks[rock];
+	double distance = COORD::EuclideanDistance(rockstate.AgentPos, RockPos[rock]);
+	double efficiency = (1 + pow(2, -distance / HalfEfficiencyDistance)) * 0.5;
+	bool correct = (observation == E_GOOD) == entry.Valuable;
+	double likelihood = correct ? efficiency : 1.0 - efficiency;
+	if (likelihood == 0 || stepObs == observation)
+		return likelihood;
+
+	// Step counted the simulated reading, swap it for the real one
+	if (observation == E_GOOD)
+	{
+		entry.Count += 2;
+		entry.LikelihoodValuable *= efficiency / (1.0 - efficiency);
+		entry.LikelihoodWorthless *= (1.0 - efficiency) / efficiency;
+	}
+	else
+	{
+		entry.Count -= 2;
+		entry.LikelihoodWorthless *= efficiency / (1.0 - efficiency);
+		entry.LikelihoodValuable *= (1.0 - efficiency) / efficiency;
+	}
+	double denom = (0.5 * entry.LikelihoodValuable) +
+		(0.5 * entry.LikelihoodWorthless);
+	entry.ProbValuable = (0.5 * entry.LikelihoodValuable) / denom;
+	return likelihood;
+}
+
+uint64_t ROCKSAMPLE::Hash(const STATE& state) const
+{
+	const ROCKSAMPLE_STATE& rockstate = safe_cast<const ROCKSAMPLE_STATE&>(state);
+	uint64_t hash = HashCombine(rockstate.AgentPos.X, rockstate.AgentPos.Y);
+	hash = HashCombine(hash, rockstate.Target);
+	for (int rock = 0; rock < NumRocks; rock++)
+	{
+		const ROCKSAMPLE_STATE::ENTRY& entry = rockstate.Rocks[rock];
+		hash = HashCombine(hash, entry.Valuable + 2 * entry.Collected);
+		hash = HashCombine(hash, entry.Count);
+		hash = HashCombine(hash, entry.Measured);
+	}
+	return hash;
+}
+
+bool ROCKSAMPLE::Equal(const STATE& state1, const STATE& state2) const
+{
+	const ROCKSAMPLE_STATE& rockstate1 = safe_cast<const ROCKSAMPLE_STATE&>(state1);
+	const ROCKSAMPLE_STATE& rockstate2 = safe_cast<const ROCKSAMPLE_STATE&>(state2);
+	if (rockstate1.AgentPos != rockstate2.AgentPos
+		|| rockstate1.Target != rockstate2.Target)
+		return false;
+	for (int rock = 0; rock < NumRocks; rock++)
+	{
+		const ROCKSAMPLE_STATE::ENTRY& entry1 = rockstate1.Rocks[rock];
+		const ROCKSAMPLE_STATE::ENTRY& entry2 = rockstate2.Rocks[rock];
+		if (entry1.Valuable != entry2.Valuable
+			|| entry1.Collected != entry2.Collected
+			|| entry1.Count != entry2.Count
+			|| entry1.Measured != entry2.Measured
+			|| entry1.LikelihoodValuable != entry2.LikelihoodValuable
+			|| entry1.LikelihoodWorthless != entry2.LikelihoodWorthless
+			|| entry1.ProbValuable != entry2.ProbValuable)
+			return false;
+	}
+	return true;
+}
+
+// Probability that each rock is valuable under the root beliefs. Rocks do
+// not change value, so this holds at any depth of the search. Too few
+// particles give no summary, which leaves the history tallies in charge
+void ROCKSAMPLE::SummariseBeliefs(const BELIEF_STATE& beliefs,
+	std::vector<double>& summary) const
+{
+	summary.clear();
+	if (beliefs.GetNumParticles() < MinSummaryParticles)
+		return;
+
+	summary.assign(NumRocks, 0.0);
+	for (int i = 0; i < beliefs.GetNumSamples(); i++)
+	{
+		const ROCKSAMPLE_STATE& rockstate =
+			safe_cast<const ROCKSAMPLE_STATE&>(*beliefs.GetSample(i));
+		const int multiplicity = beliefs.GetMultiplicity(i);
+		for (int rock = 0; rock < NumRocks; rock++)
+			summary[rock] += rockstate.Rocks[rock].Valuable * multiplicity;
+	}
+	const double scale = 1.0 / beliefs.GetNumParticles();
+	for (int rock = 0; rock < NumRocks; rock++)
+		summary[rock] *= scale;
+}
+
 void ROCKSAMPLE::GenerateLegal(const STATE& state, const HISTORY& history,
-	vector<int>& legal, const STATUS& status) const
+	ACTION_SET& legal, const STATUS& status) const
 {
 
 	const ROCKSAMPLE_STATE& rockstate =
@@ -291,8 +395,31 @@ void ROCKSAMPLE::GenerateLegal(const STATE& state, const HISTORY& history,
 			legal.push_back(rock + 1 + E_SAMPLE);
 }
 
+// Good minus bad readings of a rock, from the tallies kept by the history
+int ROCKSAMPLE::Evidence(const HISTORY& history, int rock) const
+{
+	int action = rock + 1 + E_SAMPLE;
+	return history.GetCount(action, E_GOOD) - history.GetCount(action, E_BAD);
+}
+
+const double ROCKSAMPLE::SummaryMargin = 0.01;
+
+// Rocks that are almost surely good or bad under the root beliefs need no
+// evidence from the history
+bool ROCKSAMPLE::KnownGood(const STATUS& status, int rock) const
+{
+	return status.BeliefSummary
+		&& (*status.BeliefSummary)[rock] > 1.0 - SummaryMargin;
+}
+
+bool ROCKSAMPLE::KnownBad(const STATUS& status, int rock) const
+{
+	return status.BeliefSummary
+		&& (*status.BeliefSummary)[rock] < SummaryMargin;
+}
+
 void ROCKSAMPLE::GeneratePreferred(const STATE& state, const HISTORY& history,
-	vector<int>& actions, const STATUS& status) const
+	ACTION_SET& actions, const STATUS& status) const
 {
 
 	static const bool UseBlindPolicy = false;
@@ -310,23 +437,11 @@ void ROCKSAMPLE::GeneratePreferred(const STATE& state, const HISTORY& history,
 	int rock = Grid(rockstate.AgentPos);
 	if (rock >= 0 && !rockstate.Rocks[rock].Collected)
 	{
-		int total = 0;
-		for (int t = 0; t < history.Size(); ++t)
-		{
-			if (history[t].Action == rock + 1 + E_SAMPLE)
-			{
-				if (history[t].Observation == E_GOOD)
-					total++;
-				if (history[t].Observation == E_BAD)
-					total--;
-			}
-		}
-		if (total > 0)
+		if (KnownGood(status, rock) || Evidence(history, rock) > 0)
 		{
 			actions.push_back(E_SAMPLE);
 			return;
 		}
-
 	}
 
 	// processes the rocks
@@ -339,21 +454,9 @@ void ROCKSAMPLE::GeneratePreferred(const STATE& state, const HISTORY& history,
 	for (int rock = 0; rock < NumRocks; ++rock)
 	{
 		const ROCKSAMPLE_STATE::ENTRY& entry = rockstate.Rocks[rock];
-		if (!entry.Collected)
+		if (!entry.Collected && !KnownBad(status, rock))
 		{
-			int total = 0;
-			for (int t = 0; t < history.Size(); ++t)
-			{
-				if (history[t].Action == rock + 1 + E_SAMPLE)
-				{
-					if (history[t].Observation == E_GOOD)
-						total++;
-					if (history[t].Observation == E_BAD)
-						total--;
-				}
-			}
-
-			if (total >= 0)
+			if (KnownGood(status, rock) || Evidence(history, rock) >= 0)
 			{
 				all_bad = false;
 
@@ -399,6 +502,7 @@ void ROCKSAMPLE::GeneratePreferred(const STATE& state, const HISTORY& history,
 	for (rock = 0; rock < NumRocks; ++rock)
 	{
 		if (!rockstate.Rocks[rock].Collected    &&
+			!KnownGood(status, rock) && !KnownBad(status, rock) &&
 			rockstate.Rocks[rock].ProbValuable != 0.0 &&
 			rockstate.Rocks[rock].ProbValuable != 1.0 &&
 			rockstate.Rocks[rock].Measured < 5 &&
@@ -20,7 +20,8 @@ public:
 		double LikelihoodWorthless;	// Smart knowledge
 		double ProbValuable;		// Smart knowledge
 	};
-	std::vector<ENTRY> Rocks;
+	static const int MaxRocks = 16;
+	ENTRY Rocks[MaxRocks]; // fixed size so that states are trivially copyable
 	int Target; // Smart knowledge
 };
 
@@ -38,11 +39,19 @@ public:
 		int& observation, double& reward) const;
 
 	void GenerateLegal(const STATE& state, const HISTORY& history,
-		std::vector<int>& legal, const STATUS& status) const;
+		ACTION_SET& legal, const STATUS& status) const;
 	void GeneratePreferred(const STATE& state, const HISTORY& history,
-		std::vector<int>& legal, const STATUS& status) const;
+		ACTION_SET& legal, const STATUS& status) const;
 	virtual bool LocalMove(STATE& state, const HISTORY& history,
 		int stepObservation, const STATUS& status) const;
+	virtual bool HasObservationLikelihood() const { return true; }
+	virtual double ObservationLikelihood(STATE& state, int action,
+		int stepObservation, int observation) const;
+	virtual bool HasStateHash() const { return true; }
+	virtual uint64_t Hash(const STATE& state) const;
+	virtual bool Equal(const STATE& state1, const STATE& state2) const;
+	virtual void SummariseBeliefs(const BELIEF_STATE& beliefs,
+		std::vector<double>& summary) const;
 
 	virtual void DisplayBeliefs(const BELIEF_STATE& beliefState,
 		std::ostream& ostr) const;
@@ -69,6 +78,14 @@ protected:
 	void Init_11_11();
 	int GetObservation(const ROCKSAMPLE_STATE& rockstate, int rock) const;
 	int SelectTarget(const ROCKSAMPLE_STATE& rockstate) const;
+	int Evidence(const HISTORY& history, int rock) const;
+	bool KnownGood(const STATUS& status, int rock) const;
+	bool KnownBad(const STATUS& status, int rock) const;
+
+	// Root beliefs with fewer particles are not summarised, and a summary
+	// only settles a rock when it is within SummaryMargin of certain
+	static const int MinSummaryParticles = 100;
+	static const double SummaryMargin;
 
 	GRID<int> Grid;
 	std::vector<COORD> RockPos;
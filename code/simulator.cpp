@@ -13,7 +13,9 @@ SIMULATOR::KNOWLEDGE::KNOWLEDGE()
 
 SIMULATOR::STATUS::STATUS()
 	: Phase(TREE),
-	Particles(CONSISTENT)
+	Particles(CONSISTENT),
+	BeliefSummary(0),
+	BeliefSummaryDepth(0)
 {
 }
 
@@ -21,14 +23,16 @@ SIMULATOR::SIMULATOR()
 	: Discount(1.0),
 	NumActions(0),
 	NumObservations(0),
-	RewardRange(1.0)
+	RewardRange(1.0),
+	StateSize(0)
 {
 }
 
 SIMULATOR::SIMULATOR(int numActions, int numObservations, double discount)
 	: NumActions(numActions),
 	NumObservations(numObservations),
-	Discount(discount)
+	Discount(discount),
+	StateSize(0)
 {
 	assert(discount > 0 && discount <= 1);
 }
@@ -47,22 +51,59 @@ bool SIMULATOR::LocalMove(STATE& state, const HISTORY& history,
 	return true;
 }
 
+bool SIMULATOR::HasObservationLikelihood() const
+{
+	return false;
+}
+
+double SIMULATOR::ObservationLikelihood(STATE& state, int action,
+	int stepObs, int observation) const
+{
+	return stepObs == observation ? 1.0 : 0.0;
+}
+
+bool SIMULATOR::HasStateHash() const
+{
+	return false;
+}
+
+uint64_t SIMULATOR::Hash(const STATE& state) const
+{
+	return 0;
+}
+
+bool SIMULATOR::Equal(const STATE& state1, const STATE& state2) const
+{
+	return false;
+}
+
+bool SIMULATOR::HasCommutativeHistory() const
+{
+	return false;
+}
+
+void SIMULATOR::SummariseBeliefs(const BELIEF_STATE& beliefs,
+	std::vector<double>& summary) const
+{
+	summary.clear();
+}
+
 void SIMULATOR::GenerateLegal(const STATE& state, const HISTORY& history,
-	std::vector<int>& actions, const STATUS& status) const
+	ACTION_SET& actions, const STATUS& status) const
 {
 	for (int a = 0; a < NumActions; ++a)
 		actions.push_back(a);
 }
 
 void SIMULATOR::GeneratePreferred(const STATE& state, const HISTORY& history,
-	std::vector<int>& actions, const STATUS& status) const
+	ACTION_SET& actions, const STATUS& status) const
 {
 }
 
 int SIMULATOR::SelectRandom(const STATE& state, const HISTORY& history,
 	const STATUS& status) const
 {
-	static vector<int> actions;
+	ACTION_SET actions;
 	if (Knowledge.RolloutLevel >= KNOWLEDGE::SMART)
 	{
 		actions.clear();
@@ -85,7 +126,7 @@ int SIMULATOR::SelectRandom(const STATE& state, const HISTORY& history,
 void SIMULATOR::Prior(const STATE* state, const HISTORY& history,
 	VNODE* vnode, const STATUS& status) const
 {
-	static vector<int> actions;
+	ACTION_SET actions;
 
 	if (Knowledge.TreeLevel == KNOWLEDGE::PURE || state == 0)
 	{
@@ -102,12 +143,10 @@ void SIMULATOR::Prior(const STATE* state, const HISTORY& history,
 		actions.clear();
 		GenerateLegal(*state, history, actions, status);
 
-		for (vector<int>::const_iterator i_action = actions.begin(); i_action != actions.end(); ++i_action)
+		for (const int* i_action = actions.begin(); i_action != actions.end(); ++i_action)
 		{
 			int a = *i_action;
-			QNODE& qnode = vnode->Child(a);
-			qnode.Value.Set(0, 0);
-			qnode.AMAF.Set(0, 0);
+			vnode->SetChildValue(a, 0, 0);
 		}
 	}
 
@@ -116,12 +155,10 @@ void SIMULATOR::Prior(const STATE* state, const HISTORY& history,
 		actions.clear();
 		GeneratePreferred(*state, history, actions, status);
 
-		for (vector<int>::const_iterator i_action = actions.begin(); i_action != actions.end(); ++i_action)
+		for (const int* i_action = actions.begin(); i_action != actions.end(); ++i_action)
 		{
 			int a = *i_action;
-			QNODE& qnode = vnode->Child(a);
-			qnode.Value.Set(Knowledge.SmartTreeCount, Knowledge.SmartTreeValue);
-			qnode.AMAF.Set(Knowledge.SmartTreeCount, Knowledge.SmartTreeValue);
+			vnode->SetChildValue(a, Knowledge.SmartTreeCount, Knowledge.SmartTreeValue);
 		}
 	}
 }
@@ -171,7 +208,7 @@ double SIMULATOR::GetHorizon(double accuracy, int undiscountedHorizon) const
 }
 
 void SIMULATOR::GenerateActionSpace(const STATE& state, const HISTORY& history,
-	std::vector<int>& actions, const STATUS& status, const bool preferred) const
+	ACTION_SET& actions, const STATUS& status, const bool preferred) const
 {
 	actions.clear();
 	if (Knowledge.RolloutLevel >= KNOWLEDGE::SMART && preferred)
@@ -1,6 +1,7 @@
 #ifndef SIMULATOR_H
 #define SIMULATOR_H
 
+#include "actionset.h"
 #include "history.h"
 #include "node.h"
 #include "utils.h"
@@ -12,6 +13,8 @@ class BELIEF_STATE;
 class STATE : public MEMORY_OBJECT
 {
 public:
+	STATE() : ScenarioId(0) { }
+
 	int ScenarioId;
 };
 
@@ -67,6 +70,11 @@ public:
 
 		int Phase;
 		int Particles;
+
+		// Summary of the root beliefs from SummariseBeliefs, or 0, and the
+		// history size at the root it describes
+		const std::vector<double>* BeliefSummary;
+		int BeliefSummaryDepth;
 	};
 
 	SIMULATOR();
@@ -94,6 +102,31 @@ public:
 	virtual bool LocalMove(STATE& state, const HISTORY& history,
 		int stepObs, const STATUS& status) const;
 
+	// Likelihood of the real observation for a state that has just been
+	// stepped, where stepObs is the observation produced by Step. May update
+	// knowledge in the state to be consistent with the real observation.
+	// Default is exact for domains with deterministic observations
+	virtual bool HasObservationLikelihood() const;
+	virtual double ObservationLikelihood(STATE& state, int action,
+		int stepObs, int observation) const;
+
+	// Hash and equality of full states, used to merge duplicate particles.
+	// Equal states must have equal hashes
+	virtual bool HasStateHash() const;
+	virtual uint64_t Hash(const STATE& state) const;
+	virtual bool Equal(const STATE& state1, const STATE& state2) const;
+
+	// True if the beliefs after a history depend only on which steps it holds,
+	// not their order. Tree nodes are then shared between histories that are
+	// permutations of each other. Moving agents and opponents break this
+	virtual bool HasCommutativeHistory() const;
+
+	// Summary statistics of the root beliefs, computed once per update and
+	// passed to the knowledge functions through STATUS. The layout is up to
+	// the domain, an empty summary means none is available
+	virtual void SummariseBeliefs(const BELIEF_STATE& beliefs,
+		std::vector<double>& summary) const;
+
 	// Use domain knowledge to assign prior value and confidence to actions
 	// Should only use fully observable state variables
 	void Prior(const STATE* state, const HISTORY& history, VNODE* vnode,
@@ -106,11 +139,11 @@ public:
 
 	// Generate set of legal actions
 	virtual void GenerateLegal(const STATE& state, const HISTORY& history,
-		std::vector<int>& actions, const STATUS& status) const;
+		ACTION_SET& actions, const STATUS& status) const;
 
 	// Generate set of preferred actions
 	virtual void GeneratePreferred(const STATE& state, const HISTORY& history,
-		std::vector<int>& actions, const STATUS& status) const;
+		ACTION_SET& actions, const STATUS& status) const;
 
 	// For explicit POMDP computation only
 	virtual bool HasAlpha() const;
@@ -132,15 +165,20 @@ public:
 	bool IsEpisodic() const { return false; }
 	double GetDiscount() const { return Discount; }
 	double GetRewardRange() const { return RewardRange; }
+	int GetStateSize() const { return StateSize; }
 	double GetHorizon(double accuracy, int undiscountedHorizon = 100) const;
 	void GenerateActionSpace(const STATE& state, const HISTORY& history,
-		std::vector<int>& actions, const STATUS& status, const bool preferred) const;
+		ACTION_SET& actions, const STATUS& status, const bool preferred) const;
 
 protected:
 
 	int NumActions, NumObservations;
 	double Discount, RewardRange;
 	KNOWLEDGE Knowledge;
+
+	// Size of a state for domains whose states are trivially copyable,
+	// so that beliefs can store them by value. Zero otherwise
+	int StateSize;
 };
 
 #endif // SIMULATOR_H
@@ -1,9 +1,14 @@
 #include "tag.h"
+#include "beliefstate.h"
+#include <stdexcept>
+#include <type_traits>
 
 using namespace std;
 using namespace UTILS;
 
 const int TAG::NumCells = 29;
+static_assert(std::is_trivially_copyable<TAG_STATE>::value,
+	"TAG beliefs store states by value");
 
 TAG::TAG(int opponents)
 	: NumOpponents(opponents)
@@ -12,6 +17,9 @@ TAG::TAG(int opponents)
 	NumObservations = NumCells + 1;
 	RewardRange = 10 * NumOpponents;
 	Discount = 0.95;
+	StateSize = sizeof(TAG_STATE);
+	if (NumOpponents > TAG_STATE::MaxOpponents)
+		throw std::invalid_argument("TAG: more opponents than TAG_STATE::MaxOpponents");
 }
 
 STATE* TAG::Copy(const STATE& state) const
@@ -33,9 +41,8 @@ STATE* TAG::CreateStartState() const
 	TAG_STATE* tagstate = MemoryPool.Allocate();
 	tagstate->NumAlive = NumOpponents;
 	tagstate->AgentPos = GetCoord(Random(NumCells));
-	tagstate->OpponentPos.clear();
 	for (int i = 0; i < NumOpponents; ++i)
-		tagstate->OpponentPos.push_back(GetCoord(Random(NumCells)));
+		tagstate->OpponentPos[i] = GetCoord(Random(NumCells));
 	return tagstate;
 }
 
@@ -166,7 +173,7 @@ void TAG::MoveOpponent(TAG_STATE& tagstate, int opp) const
 	const COORD& agent = tagstate.AgentPos;
 	COORD& opponent = tagstate.OpponentPos[opp];
 
-	static vector<int> actions;
+	ACTION_SET actions;
 	actions.clear();
 
 	if (opponent.X >= agent.X)
@@ -212,8 +219,59 @@ bool TAG::LocalMove(STATE& state, const HISTORY& history,
 	return simObs == realObs;
 }
 
+uint64_t TAG::Hash(const STATE& state) const
+{
+	const TAG_STATE& tagstate = safe_cast<const TAG_STATE&>(state);
+	uint64_t hash = HashCombine(GetIndex(tagstate.AgentPos), tagstate.NumAlive);
+	for (int opp = 0; opp < NumOpponents; ++opp)
+	{
+		// Tagged opponents have invalid positions, so hash coordinates directly
+		hash = HashCombine(hash, tagstate.OpponentPos[opp].X);
+		hash = HashCombine(hash, tagstate.OpponentPos[opp].Y);
+	}
+	return hash;
+}
+
+bool TAG::Equal(const STATE& state1, const STATE& state2) const
+{
+	const TAG_STATE& tagstate1 = safe_cast<const TAG_STATE&>(state1);
+	const TAG_STATE& tagstate2 = safe_cast<const TAG_STATE&>(state2);
+	if (tagstate1.AgentPos != tagstate2.AgentPos
+		|| tagstate1.NumAlive != tagstate2.NumAlive)
+		return false;
+	for (int opp = 0; opp < NumOpponents; ++opp)
+		if (tagstate1.OpponentPos[opp] != tagstate2.OpponentPos[opp])
+			return false;
+	return true;
+}
+
+// Expected number of opponents in each cell under the root beliefs, followed
+// by the index of the most likely cell
+void TAG::SummariseBeliefs(const BELIEF_STATE& beliefs,
+	std::vector<double>& summary) const
+{
+	summary.assign(NumCells + 1, 0.0);
+	for (int i = 0; i < beliefs.GetNumSamples(); i++)
+	{
+		const TAG_STATE& tagstate = safe_cast<const TAG_STATE&>(*beliefs.GetSample(i));
+		const int multiplicity = beliefs.GetMultiplicity(i);
+		for (int opp = 0; opp < NumOpponents; ++opp)
+			if (IsAlive(tagstate, opp))
+				summary[GetIndex(tagstate.OpponentPos[opp])] += multiplicity;
+	}
+	const double scale = 1.0 / beliefs.GetNumParticles();
+	int likely = 0;
+	for (int cell = 0; cell < NumCells; cell++)
+	{
+		summary[cell] *= scale;
+		if (summary[cell] > summary[likely])
+			likely = cell;
+	}
+	summary[NumCells] = likely;
+}
+
 void TAG::GeneratePreferred(const STATE& state, const HISTORY& history,
-	vector<int>& actions, const STATUS& status) const
+	ACTION_SET& actions, const STATUS& status) const
 {
 	const TAG_STATE& tagstate = safe_cast<const TAG_STATE&>(state);
 
@@ -228,6 +286,22 @@ void TAG::GeneratePreferred(const STATE& state, const HISTORY& history,
 		return;
 	}
 
+	// Head for the most likely opponent cell of the root beliefs. Deeper in
+	// the tree the opponents have moved on, so this only applies at the root
+	if (status.BeliefSummary && history.Size() == status.BeliefSummaryDepth)
+	{
+		COORD target = GetCoord((int) status.BeliefSummary->back());
+		int distance = COORD::ManhattanDistance(tagstate.AgentPos, target);
+		int numActions = actions.size();
+		for (int d = 0; d < 4; ++d)
+			if (history.Back().Action != COORD::Opposite(d)
+				&& Inside(tagstate.AgentPos + COORD::Compass[d])
+				&& COORD::ManhattanDistance(tagstate.AgentPos + COORD::Compass[d], target) < distance)
+				actions.push_back(d);
+		if (actions.size() > numActions)
+			return;
+	}
+
 	// Don't double back and don't go into walls
 	for (int d = 0; d < 4; ++d)
 		if (history.Back().Action != COORD::Opposite(d)
@@ -9,8 +9,9 @@ class TAG_STATE : public STATE
 {
 public:
 
+	static const int MaxOpponents = 4;
 	COORD AgentPos;
-	std::vector<COORD> OpponentPos;
+	COORD OpponentPos[MaxOpponents]; // fixed size so that states are trivially copyable
 	int NumAlive;
 };
 
@@ -28,9 +29,15 @@ public:
 		int& observation, double& reward) const;
 
 	void GeneratePreferred(const STATE& state, const HISTORY& history,
-		std::vector<int>& legal, const STATUS& status) const;
+		ACTION_SET& legal, const STATUS& status) const;
 	virtual bool LocalMove(STATE& state, const HISTORY& history,
 		int stepObs, const STATUS& status) const;
+	virtual bool HasObservationLikelihood() const { return true; }
+	virtual bool HasStateHash() const { return true; }
+	virtual uint64_t Hash(const STATE& state) const;
+	virtual bool Equal(const STATE& state1, const STATE& state2) const;
+	virtual void SummariseBeliefs(const BELIEF_STATE& beliefs,
+		std::vector<double>& summary) const;
 
 	virtual void DisplayBeliefs(const BELIEF_STATE& beliefState,
 		std::ostream& ostr) const;
@@ -21,6 +21,17 @@ void TEST_SIMULATOR::FreeState(STATE* state) const
 	delete state;
 }
 
+uint64_t TEST_SIMULATOR::Hash(const STATE& state) const
+{
+	return safe_cast<const TEST_STATE&>(state).Depth;
+}
+
+bool TEST_SIMULATOR::Equal(const STATE& state1, const STATE& state2) const
+{
+	return safe_cast<const TEST_STATE&>(state1).Depth
+		== safe_cast<const TEST_STATE&>(state2).Depth;
+}
+
 bool TEST_SIMULATOR::Step(STATE& state, int action,
 	int& observation, double& reward) const
 {
@@ -28,6 +28,11 @@ public:
 	virtual STATE* Copy(const STATE& state) const;
 	virtual void FreeState(STATE* state) const;
 
+	// States are equal when they are at the same depth
+	virtual bool HasStateHash() const { return true; }
+	virtual uint64_t Hash(const STATE& state) const;
+	virtual bool Equal(const STATE& state1, const STATE& state2) const;
+
 	double OptimalValue() const;
 	double MeanValue() const;
 
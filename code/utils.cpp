@@ -3,6 +3,8 @@
 namespace UTILS
 {
 
+	thread_local std::mt19937* ThreadGenerator = 0;
+
 	void UnitTest()
 	{
 		assert(Sign(+10) == +1);
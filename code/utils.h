@@ -5,9 +5,11 @@
 #include <stdlib.h>
 #include <math.h>
 #include <assert.h>
+#include <stdint.h>
 #include "coord.h"
 #include "memorypool.h"
 #include <algorithm>
+#include <random>
 
 #define LargeInteger 1000000
 #define Infinity 1e+10
@@ -27,19 +29,30 @@ namespace UTILS
 		return (x > 0) - (x < 0);
 	}
 
+	// Worker threads install their own generator here, all other code
+	// draws from the C library generator
+	extern thread_local std::mt19937* ThreadGenerator;
+
+	inline int Rand()
+	{
+		if (ThreadGenerator)
+			return (*ThreadGenerator)() % ((unsigned int) RAND_MAX + 1);
+		return rand();
+	}
+
 	inline int Random(int max)
 	{
-		return rand() % max;
+		return Rand() % max;
 	}
 
 	inline int Random(int min, int max)
 	{
-		return rand() % (max - min) + min;
+		return Rand() % (max - min) + min;
 	}
 
 	inline double RandomDouble(double min, double max)
 	{
-		return (double)rand() / RAND_MAX * (max - min) + min;
+		return (double)Rand() / RAND_MAX * (max - min) + min;
 	}
 
 	inline void RandomSeed(int seed)
@@ -49,7 +62,7 @@ namespace UTILS
 
 	inline bool Bernoulli(double p)
 	{
-		return rand() < p * RAND_MAX;
+		return Rand() < p * RAND_MAX;
 	}
 
 	inline bool Near(double x, double y, double tol)
@@ -61,6 +74,12 @@ namespace UTILS
 
 	inline void SetFlag(int& flags, int bit) { flags = (flags | (1 << bit)); }
 
+	// Mixes a value into a running hash
+	inline uint64_t HashCombine(uint64_t hash, uint64_t value)
+	{
+		return hash ^ (value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2));
+	}
+
 	template<class T>
 	inline bool Contains(std::vector<T>& vec, const T& item)
 	{